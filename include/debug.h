@@ -2,6 +2,7 @@
 #define _DEBUG_H_
 
 #include <mutex>
+#include <string>
 #include <stdio.h>
 #include <cstdio>
 #include <errno.h>
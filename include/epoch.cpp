@@ -0,0 +1,257 @@
+#include "epoch.h"
+
+#include <thread>
+
+static std::atomic<uint64_t> s_ullNextSerial(1);
+
+/*
+per-thread table of the domains the thread has a slot in. the destructor runs at thread exit
+and gives the slots back, handing leftover retired nodes to domains that are still alive.
+*/
+struct tagEpochThread
+{
+    typedef struct tagEntry
+    {
+        EpochDomain*                         pinstDomain;
+        uint64_t                             ullSerial;
+        std::weak_ptr<EpochDomain::Shared>   wpShared;
+        EpochDomain::PSlot                   pstSlot;
+    }Entry;
+
+    EpochDomain*        pinstLast = nullptr;    // one domain is the common case, skip the scan
+    uint64_t            ullLastSerial = 0;
+    EpochDomain::PSlot  pstLast = nullptr;
+    std::vector<Entry>  vecEntries;
+
+    ~tagEpochThread()
+    {
+        for (auto& stEntry : vecEntries) {
+            std::shared_ptr<EpochDomain::Shared> pShared = stEntry.wpShared.lock();
+            if (pShared) {
+                EpochDomain::__releaseSlot(pShared, stEntry.pinstDomain, stEntry.pstSlot);
+            }
+        }
+    }
+};
+
+static thread_local tagEpochThread tl_stEpochThread;
+
+EpochDomain::EpochDomain() :
+    m_pShared_(new Shared()),
+    m_ullSerial_(s_ullNextSerial++),
+    m_ullEpoch_(1),
+    m_uPending_(0),
+    m_ullRetired_(0),
+    m_ullFreed_(0)
+{
+    for (auto& stSlot : m_pShared_->astSlots) {
+        stSlot.ullPinned.store(0);
+        stSlot.bUsed.store(false);
+        stSlot.uNest = 0;
+    }
+    m_pShared_->uSlotsHigh.store(0);
+}
+
+EpochDomain::~EpochDomain()
+{
+    for (auto& stBatch : m_qPending_) {
+        for (auto& stRetired : stBatch.vecNodes) {
+            stRetired.pfnDelete(stRetired.pvNode);
+        }
+    }
+    for (auto& stSlot : m_pShared_->astSlots) {
+        for (auto& stRetired : stSlot.vecBag) {
+            stRetired.pfnDelete(stRetired.pvNode);
+        }
+    }
+}
+
+void EpochDomain::enter()
+{
+    PSlot pstSlot = __slot(true);
+    if (pstSlot->uNest++ == 0) {
+        // a stale epoch only holds the next advance back, it never lets one through early
+        pstSlot->ullPinned.store(m_ullEpoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void EpochDomain::leave()
+{
+    PSlot pstSlot = __slot(true);
+    if (--pstSlot->uNest == 0) {
+        pstSlot->ullPinned.store(0, std::memory_order_release);
+    }
+}
+
+/*
+queue a node that is no longer reachable for deletion. it is kept in the caller's bag until
+EPOCH_RETIRE_BATCH have gathered, the batch then waits in the domain for reclaim().
+*/
+void EpochDomain::retire(void* pvNode, Deleter_T pfnDelete)
+{
+    PSlot pstSlot = __slot(true);
+    Retired stRetired = { pvNode, pfnDelete };
+    pstSlot->vecBag.push_back(stRetired);
+    m_ullRetired_.fetch_add(1, std::memory_order_relaxed);
+    if (pstSlot->vecBag.size() < EPOCH_RETIRE_BATCH) {
+        return;
+    }
+    __handOver(pstSlot);
+    if (m_uPending_.load(std::memory_order_relaxed) > EPOCH_MAX_PENDING) {
+        reclaim();      // nobody reclaims, don't let the backlog grow without bound
+    }
+    else {
+        __tryAdvance();
+    }
+}
+
+/*
+free every batch retired two or more epochs ago. the caller's own bag is handed over first so
+a thread going idle leaves nothing behind. without pending batches it is a TLS lookup and a load.
+*/
+size_t EpochDomain::reclaim()
+{
+    PSlot pstSlot = __slot(false);
+    if (pstSlot != nullptr && !pstSlot->vecBag.empty()) {
+        __handOver(pstSlot);
+    }
+    if (m_uPending_.load(std::memory_order_relaxed) == 0) {
+        return 0;
+    }
+
+    // aim at the newest batch, the caller's own included: a peer that advanced for an older one
+    // meanwhile may have gone to sleep without freeing it
+    uint64_t ullNewest;
+    {
+        std::lock_guard<std::mutex> guard(m_mtxPending_);
+        ullNewest = m_qPending_.empty() ? 0 : m_qPending_.back().ullEpoch;
+    }
+    // at most two steps, each needs the pinned threads to have caught up
+    while (m_ullEpoch_.load() < ullNewest + 2 && __tryAdvance()) {
+    }
+
+    std::vector<Batch> vecFree;
+    {
+        std::lock_guard<std::mutex> guard(m_mtxPending_);
+        uint64_t ullEpoch = m_ullEpoch_.load(std::memory_order_acquire);
+        while (!m_qPending_.empty() && m_qPending_.front().ullEpoch + 2 <= ullEpoch) {
+            vecFree.push_back(std::move(m_qPending_.front()));
+            m_qPending_.pop_front();
+        }
+        m_uPending_.store(m_qPending_.size(), std::memory_order_relaxed);
+    }
+
+    size_t uFreed = 0;
+    for (auto& stBatch : vecFree) {
+        for (auto& stRetired : stBatch.vecNodes) {
+            stRetired.pfnDelete(stRetired.pvNode);
+        }
+        uFreed += stBatch.vecNodes.size();
+    }
+    m_ullFreed_.fetch_add(uFreed, std::memory_order_relaxed);
+    return uFreed;
+}
+
+void EpochDomain::synchronize()
+{
+    reclaim();
+    while (m_uPending_.load() != 0) {
+        if (reclaim() == 0) {
+            std::this_thread::yield();      // a reader is still pinned
+        }
+    }
+}
+
+EpochDomain::EpochStats EpochDomain::getStats()
+{
+    EpochStats stStats;
+    stStats.ullEpoch = m_ullEpoch_.load();
+    stStats.ullRetired = m_ullRetired_.load();
+    stStats.ullFreed = m_ullFreed_.load();
+    stStats.uPendingBatches = m_uPending_.load();
+    return stStats;
+}
+
+EpochDomain::PSlot EpochDomain::__slot(bool bCreate)
+{
+    tagEpochThread& stThread = tl_stEpochThread;
+    if (stThread.pinstLast == this && stThread.ullLastSerial == m_ullSerial_) {
+        return stThread.pstLast;
+    }
+
+    PSlot pstSlot = nullptr;
+    for (auto itEntry = stThread.vecEntries.begin(); itEntry != stThread.vecEntries.end(); ) {
+        if (itEntry->wpShared.expired()) {
+            itEntry = stThread.vecEntries.erase(itEntry);     // a dead domain, maybe at this address
+            continue;
+        }
+        if (itEntry->pinstDomain == this && itEntry->ullSerial == m_ullSerial_) {
+            pstSlot = itEntry->pstSlot;
+        }
+        ++itEntry;
+    }
+    if (pstSlot == nullptr) {
+        if (!bCreate) {
+            return nullptr;
+        }
+        // every slot taken: wait for a thread to exit
+        for (size_t i = 0; pstSlot == nullptr; i = (i + 1) % EPOCH_MAX_THREADS) {
+            bool bFree = false;
+            if (m_pShared_->astSlots[i].bUsed.compare_exchange_strong(bFree, true, std::memory_order_acquire)) {
+                pstSlot = &m_pShared_->astSlots[i];
+                size_t uHigh = m_pShared_->uSlotsHigh.load();
+                while (uHigh < i + 1 && !m_pShared_->uSlotsHigh.compare_exchange_weak(uHigh, i + 1)) {
+                }
+            }
+            else if (i == EPOCH_MAX_THREADS - 1) {
+                std::this_thread::yield();
+            }
+        }
+        tagEpochThread::Entry stEntry = { this, m_ullSerial_, m_pShared_, pstSlot };
+        stThread.vecEntries.push_back(stEntry);
+    }
+    stThread.pinstLast = this;
+    stThread.ullLastSerial = m_ullSerial_;
+    stThread.pstLast = pstSlot;
+    return pstSlot;
+}
+
+void EpochDomain::__handOver(PSlot pstSlot)
+{
+    Batch stBatch;
+    stBatch.vecNodes.swap(pstSlot->vecBag);
+    pstSlot->vecBag.reserve(EPOCH_RETIRE_BATCH);
+    std::lock_guard<std::mutex> guard(m_mtxPending_);
+    // read under the lock so m_qPending_ stays in epoch order
+    stBatch.ullEpoch = m_ullEpoch_.load(std::memory_order_seq_cst);
+    m_qPending_.push_back(std::move(stBatch));
+    m_uPending_.store(m_qPending_.size(), std::memory_order_relaxed);
+}
+
+/*
+move the global epoch on if every pinned thread has seen the current one.
+*/
+bool EpochDomain::__tryAdvance()
+{
+    uint64_t ullEpoch = m_ullEpoch_.load(std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    size_t uHigh = m_pShared_->uSlotsHigh.load(std::memory_order_acquire);
+    for (size_t i = 0; i < uHigh; ++i) {
+        uint64_t ullPinned = m_pShared_->astSlots[i].ullPinned.load(std::memory_order_acquire);
+        if (ullPinned != 0 && ullPinned != ullEpoch) {
+            return false;
+        }
+    }
+    return m_ullEpoch_.compare_exchange_strong(ullEpoch, ullEpoch + 1);
+}
+
+void EpochDomain::__releaseSlot(std::shared_ptr<Shared> pShared, EpochDomain* pinstDomain, PSlot pstSlot)
+{
+    if (!pstSlot->vecBag.empty()) {
+        pinstDomain->__handOver(pstSlot);
+    }
+    pstSlot->uNest = 0;
+    pstSlot->ullPinned.store(0, std::memory_order_release);
+    pstSlot->bUsed.store(false, std::memory_order_release);
+}
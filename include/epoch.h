@@ -0,0 +1,120 @@
+#ifndef YSP_EPOCH_H_
+#define YSP_EPOCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define EPOCH_MAX_THREADS   (256)   // threads that can be inside one domain at the same time
+#define EPOCH_RETIRE_BATCH  (64)    // retired nodes a thread collects before handing them over
+#define EPOCH_MAX_PENDING   (64)    // handed-over batches before retire() frees them itself
+
+/*
+epoch-based reclamation for lock-free structures: a node unlinked by one thread is freed only
+once no thread can still be reading it.
+a reader pins the global epoch for the length of a Guard, one store and one fence. retired
+nodes are collected per thread; full batches go to the domain tagged with the current epoch and
+are freed by reclaim() once the epoch has moved on twice, which needs every pinned thread to
+have left and re-entered. idle pool workers call reclaim(), see
+ThreadPool::setEpochDomain(); retire() frees on its own only when batches pile up.
+the domain must outlive the threads that use it.
+------------------HOW TO USE IT
+EpochDomain instDomain;
+
+// reader
+{
+    EpochDomain::Guard guard(&instDomain);
+    Node* pstNode = pstHead.load();
+    ... // pstNode stays valid until the guard is gone
+}
+
+// writer, after unlinking pstOld
+instDomain.retire(pstOld);
+*/
+class EpochDomain
+{
+public:
+    typedef void (*Deleter_T)(void*);
+    typedef struct tagEpochStats
+    {
+        uint64_t ullEpoch;
+        uint64_t ullRetired;
+        uint64_t ullFreed;
+        size_t   uPendingBatches;
+    }EpochStats, *PEpochStats;
+
+    class Guard
+    {
+    public:
+        explicit Guard(EpochDomain* pinstDomain) : m_pinstDomain_(pinstDomain) { m_pinstDomain_->enter(); }
+        ~Guard() { m_pinstDomain_->leave(); }
+    private:
+        Guard(Guard const&) = delete;
+        Guard& operator=(Guard const&) = delete;
+
+        EpochDomain* m_pinstDomain_;
+    };
+
+    EpochDomain();
+    ~EpochDomain();     // frees everything still retired, no thread may be inside
+
+    void enter();       // nests, only the outermost enter pins
+    void leave();
+
+    template <typename T>
+    void retire(T* pNode)
+    {
+        retire(pNode, [](void* pvNode) { delete (T*)pvNode; });
+    }
+    void retire(void* pvNode, Deleter_T pfnDelete);
+
+    size_t reclaim();       // hand over the caller's nodes and free what is safe, returns nodes freed
+    void synchronize();     // wait until everything retired so far is freed; not inside a Guard
+    EpochStats getStats();
+
+private:
+    typedef struct tagRetired
+    {
+        void*     pvNode;
+        Deleter_T pfnDelete;
+    }Retired;
+    typedef struct alignas(64) tagSlot
+    {
+        std::atomic<uint64_t> ullPinned;    // epoch the owner entered in, 0 outside
+        std::atomic<bool>     bUsed;
+        unsigned int          uNest;        // owner only
+        std::vector<Retired>  vecBag;       // owner only
+    }Slot, *PSlot;
+    typedef struct tagBatch
+    {
+        uint64_t             ullEpoch;
+        std::vector<Retired> vecNodes;
+    }Batch;
+    typedef struct tagShared
+    {
+        Slot                 astSlots[EPOCH_MAX_THREADS];
+        std::atomic<size_t>  uSlotsHigh;    // slots below it have been used
+    }Shared;
+
+    friend struct tagEpochThread;
+
+    PSlot __slot(bool bCreate);             // the caller's slot, taken on first use
+    void __handOver(PSlot pstSlot);         // bag -> m_qPending_, tagged with the epoch of the hand-over
+    bool __tryAdvance();
+    static void __releaseSlot(std::shared_ptr<Shared> pShared, EpochDomain* pinstDomain, PSlot pstSlot);
+
+    std::shared_ptr<Shared> m_pShared_;     // thread exit hooks hold a weak_ptr, a dead domain is skipped
+    uint64_t                m_ullSerial_;   // tells a new domain from a dead one at the same address
+    std::atomic<uint64_t>   m_ullEpoch_;
+    std::mutex              m_mtxPending_;
+    std::deque<Batch>       m_qPending_;
+    std::atomic<size_t>     m_uPending_;
+    std::atomic<uint64_t>   m_ullRetired_;
+    std::atomic<uint64_t>   m_ullFreed_;
+};
+
+#endif  //YSP_EPOCH_H_
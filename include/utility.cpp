@@ -3,42 +3,170 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#include <cctype>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 #include "debug.h"
 
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define HEXDUMP_SSSE3
+#endif
+
+namespace utility {
+
+namespace {
+/* "00".."ff" and the dump column of every byte value, built once */
+struct HexTables
+{
+    char acPairs[256][2];
+    char acColumns[256][4];     // " xx " -- stored 4 bytes at a time, advanced by 3
+    char acPrintable[256];
+    HexTables()
+    {
+        static const char s_acDigits[] = "0123456789abcdef";
+        for (int i = 0; i < 256; ++i) {
+            acPairs[i][0] = s_acDigits[i >> 4];
+            acPairs[i][1] = s_acDigits[i & 0xf];
+            acColumns[i][0] = ' ';
+            acColumns[i][1] = acPairs[i][0];
+            acColumns[i][2] = acPairs[i][1];
+            acColumns[i][3] = ' ';
+            acPrintable[i] = ('!' < i && i <= '~') ? (char)i : '.';
+        }
+    }
+};
+
+const HexTables& hexTables()
+{
+    static const HexTables s_instTables;
+    return s_instTables;
+}
+
+#ifdef HEXDUMP_SSSE3
+/* hex and char columns of a full line: nibbles -> digits with one pshufb, spread out to " xx" with two more per 16 output chars */
+inline void hexDumpColumnsSsse3(char* pcHex, char* pcChars, const unsigned char* pucData)
+{
+    const __m128i xmmDigits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i xmmLowNibble = _mm_set1_epi8(0x0f);
+    __m128i xmmData = _mm_loadu_si128((const __m128i*)pucData);
+    __m128i xmmHigh = _mm_shuffle_epi8(xmmDigits, _mm_and_si128(_mm_srli_epi16(xmmData, 4), xmmLowNibble));
+    __m128i xmmLow = _mm_shuffle_epi8(xmmDigits, _mm_and_si128(xmmData, xmmLowNibble));
+
+    // output char 3k is a space, 3k+1 the high digit of byte k, 3k+2 the low one; -1 selects zero
+    const __m128i axmmHighIdx[3] = {
+        _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1),
+        _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10),
+        _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1) };
+    const __m128i axmmLowIdx[3] = {
+        _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1),
+        _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1),
+        _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15) };
+    const __m128i axmmSpaces[3] = {
+        _mm_setr_epi8(' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' '),
+        _mm_setr_epi8(0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0),
+        _mm_setr_epi8(0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0) };
+    for (int i = 0; i < 3; ++i) {
+        __m128i xmmOut = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(xmmHigh, axmmHighIdx[i]),
+                                                   _mm_shuffle_epi8(xmmLow, axmmLowIdx[i])), axmmSpaces[i]);
+        _mm_storeu_si128((__m128i*)(pcHex + 16 * i), xmmOut);
+    }
+    pcHex[48] = ' ';
+    pcHex[49] = ' ';
+
+    // '!' < c <= '~' as signed bytes, everything else prints as '.'
+    __m128i xmmShow = _mm_and_si128(_mm_cmpgt_epi8(xmmData, _mm_set1_epi8('!')),
+                                    _mm_cmplt_epi8(xmmData, _mm_set1_epi8(0x7f)));
+    __m128i xmmChars = _mm_or_si128(_mm_and_si128(xmmShow, xmmData), _mm_andnot_si128(xmmShow, _mm_set1_epi8('.')));
+    _mm_storeu_si128((__m128i*)pcChars, xmmChars);
+}
+#endif
+
+/* one line, "<16 hex digit address> - xx xx ... xx  <chars>\n", returns its length */
+inline size_t hexDumpLine(char* pcOut, const unsigned char* pucData, size_t uCount, uintptr_t uAddr,
+                          const HexTables& stTables)
+{
+    char* pcPos = pcOut;
+    for (int iShift = (int)(sizeof(uint64_t) * 8) - 8; iShift >= 0; iShift -= 8) {
+        memcpy(pcPos, stTables.acPairs[((uint64_t)uAddr >> iShift) & 0xff], 2);
+        pcPos += 2;
+    }
+    *pcPos++ = ' ';
+    *pcPos++ = '-';
+
+    char* pcHex = pcPos;
+    char* pcChars = pcPos + HEXDUMP_BYTES_PER_LINE * 3 + 2;
+#ifdef HEXDUMP_SSSE3
+    if (uCount == HEXDUMP_BYTES_PER_LINE) {
+        hexDumpColumnsSsse3(pcHex, pcChars, pucData);
+        pcChars[HEXDUMP_BYTES_PER_LINE] = '\n';
+        return HEXDUMP_LINE_LEN;
+    }
+#endif
+    for (size_t i = 0; i < uCount; ++i) {
+        memcpy(pcHex, stTables.acColumns[pucData[i]], 4);
+        pcHex += 3;
+        pcChars[i] = stTables.acPrintable[pucData[i]];
+    }
+    // short last line keeps the character column aligned
+    memset(pcHex, ' ', (HEXDUMP_BYTES_PER_LINE - uCount) * 3 + 2);
+    pcChars[uCount] = '\n';
+    return (size_t)(pcChars + uCount + 1 - pcOut);
+}
+}   //anonymous
+
+size_t HexDumpSize(size_t uLen)
+{
+    size_t uLines = uLen / HEXDUMP_BYTES_PER_LINE;
+    size_t uTail = uLen % HEXDUMP_BYTES_PER_LINE;
+    return uLines * HEXDUMP_LINE_LEN + (uTail ? HEXDUMP_LINE_LEN - HEXDUMP_BYTES_PER_LINE + uTail : 0);
+}
+
+size_t HexDump(char* pcOut, size_t uOutLen, const void* pvData, size_t uLen, uintptr_t uAddr)
+{
+    const HexTables& stTables = hexTables();
+    const unsigned char* pucData = (const unsigned char*)pvData;
+    size_t uWritten = 0;
+
+    for (size_t uOffset = 0; uOffset < uLen; uOffset += HEXDUMP_BYTES_PER_LINE) {
+        size_t uCount = std::min(HEXDUMP_BYTES_PER_LINE, uLen - uOffset);
+        if (uOutLen - uWritten < HEXDUMP_LINE_LEN - HEXDUMP_BYTES_PER_LINE + uCount) {
+            break;      // only whole lines are written
+        }
+        uWritten += hexDumpLine(pcOut + uWritten, pucData + uOffset, uCount, uAddr + uOffset, stTables);
+    }
+    return uWritten;
+}
+
+bool HexDumpToFile(FILE* pFile, const void* pvData, size_t uLen, uintptr_t uAddr)
+{
+    const size_t uBlockBytes = 256 * HEXDUMP_BYTES_PER_LINE;
+    char acBlock[256 * HEXDUMP_LINE_LEN];
+    const char* pcData = (const char*)pvData;
+
+    for (size_t uOffset = 0; uOffset < uLen; uOffset += uBlockBytes) {
+        size_t uCount = std::min(uBlockBytes, uLen - uOffset);
+        size_t uText = HexDump(acBlock, sizeof(acBlock), pcData + uOffset, uCount, uAddr + uOffset);
+        if (uText != fwrite(acBlock, 1, uText, pFile)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}   //utility
+
 void printMemory(const char *buf, int len) {
-	int i, j, k;
-	char binstr[80];
-    int addr = (int)buf;
-	for (i = 0; i < len; i++) {
-		if (0 == (i % 16)) {
-			sprintf(binstr, "%08x -", i + addr);
-			sprintf(binstr, "%s %02x", binstr, (unsigned char)buf[i]);
-		}
-		else if (15 == (i % 16)) {
-			sprintf(binstr, "%s %02x", binstr, (unsigned char)buf[i]);
-			sprintf(binstr, "%s  ", binstr);
-			for (j = i - 15; j <= i; j++) {
-				sprintf(binstr, "%s%c", binstr, ('!' < buf[j] && buf[j] <= '~') ? buf[j] : '.');
-			}
-			printf("%s\n", binstr);
-		}
-		else {
-			sprintf(binstr, "%s %02x", binstr, (unsigned char)buf[i]);
-		}
-	}
-	if (0 != (i % 16)) {
-		k = 16 - (i % 16);
-		for (j = 0; j < k; j++) {
-			sprintf(binstr, "%s   ", binstr);
-		}
-		sprintf(binstr, "%s  ", binstr);
-		k = 16 - k;
-		for (j = i - k; j < i; j++) {
-			sprintf(binstr, "%s%c", binstr, ('!' < buf[j] && buf[j] <= '~') ? buf[j] : '.');
-		}
-		printf("%s\n", binstr);
-	}
+    if (len > 0) {
+        utility::HexDumpToFile(stdout, buf, (size_t)len, (uintptr_t)buf);
+    }
 }
 
 using namespace std;
@@ -49,7 +177,11 @@ const vector<string> StringSplit(const string& str, string delim)
 
     size_t last_seen = 0;
     size_t next = 0;
-    for (; (next = str.find(delim, last_seen)) != string::npos; last_seen = next + 1) {
+    if (delim.empty()) {
+        result.push_back(str);
+        return result;
+    }
+    for (; (next = str.find(delim, last_seen)) != string::npos; last_seen = next + delim.size()) {
         result.push_back(str.substr(last_seen, next - last_seen));
     }
     result.push_back(str.substr(last_seen));
@@ -100,6 +232,72 @@ void Trim(std::string& str)
     RightTrim(str);
 }
 
+namespace utility {
+
+size_t FindDelimiter(string_view svText, string_view svDelim, size_t uPos)
+{
+    const char* pcBegin = svText.data();
+    const char* pcEnd = pcBegin + svText.size();
+    const size_t uDelimLen = svDelim.size();
+
+    if (uDelimLen == 0 || uPos > svText.size()) {
+        return string_view::npos;
+    }
+    // memchr is vectorized by every libc, only candidates get a full compare
+    const char* pcPos = pcBegin + uPos;
+    while ((size_t)(pcEnd - pcPos) >= uDelimLen) {
+        pcPos = (const char*)memchr(pcPos, svDelim[0], (pcEnd - pcPos) - uDelimLen + 1);
+        if (pcPos == nullptr) {
+            break;
+        }
+        if (uDelimLen == 1 || 0 == memcmp(pcPos + 1, svDelim.data() + 1, uDelimLen - 1)) {
+            return (size_t)(pcPos - pcBegin);
+        }
+        ++pcPos;
+    }
+    return string_view::npos;
+}
+
+string_view LeftTrimView(string_view svText)
+{
+    size_t uPos = 0;
+    while (uPos < svText.size() && std::isspace((unsigned char)svText[uPos])) {
+        ++uPos;
+    }
+    return svText.substr(uPos);
+}
+
+string_view RightTrimView(string_view svText)
+{
+    size_t uLen = svText.size();
+    while (uLen > 0 && std::isspace((unsigned char)svText[uLen - 1])) {
+        --uLen;
+    }
+    return svText.substr(0, uLen);
+}
+
+string_view TrimView(string_view svText)
+{
+    return RightTrimView(LeftTrimView(svText));
+}
+
+void PadLeftInto(string& strOut, string_view svText, size_t uSize)
+{
+    if (svText.size() < uSize) {
+        strOut.append(uSize - svText.size(), ' ');
+    }
+    strOut.append(svText.data(), svText.size());
+}
+
+void PadRightInto(string& strOut, string_view svText, size_t uSize)
+{
+    strOut.append(svText.data(), svText.size());
+    if (svText.size() < uSize) {
+        strOut.append(uSize - svText.size(), ' ');
+    }
+}
+
+}   //utility
 
 bool SyscallErrorInfo(bool syscall_success, const char* error_message_prefix)
 {
@@ -110,10 +308,64 @@ bool SyscallErrorInfo(bool syscall_success, const char* error_message_prefix)
 }
 
 
+namespace utility {
+
+string TempFileName(const string& strFileName)
+{
+    size_t pos = strFileName.find_last_of("/\\");
+    if (pos == string::npos) {
+        return "tmp_" + strFileName;
+    }
+    return strFileName.substr(0, pos + 1) + "tmp_" + strFileName.substr(pos + 1);
+}
+
+string DirectoryOf(const string& strFileName)
+{
+    size_t pos = strFileName.find_last_of("/\\");
+    if (pos == string::npos) {
+        return ".";
+    }
+    if (pos == 0) {
+        return strFileName.substr(0, 1);
+    }
+    return strFileName.substr(0, pos);
+}
+
+bool SyncFile(FILE* pFile)
+{
+    if (0 != fflush(pFile)) {
+        return false;
+    }
+#ifdef _WIN32
+    return 0 == _commit(_fileno(pFile));
+#else
+    return 0 == fsync(fileno(pFile));
+#endif
+}
+
+bool SyncDirectory(const string& strDirName)
+{
+#ifdef _WIN32
+    // NTFS journals the rename itself, there is no directory handle to flush
+    (void)strDirName;
+    return true;
+#else
+    int fd = open(strDirName.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = (0 == fsync(fd));
+    close(fd);
+    return synced;
+#endif
+}
+
+}   //utility
+
 bool PersistentFileUpdate(const char* filename, const void* new_contents, int new_contents_len)
 {
     // assume old file is safe
-    std::string tmp_filename = "tmp_" + std::string(filename);
+    std::string tmp_filename = TempFileName(filename);
     cdebug("tmp name: %s", tmp_filename.c_str());
     FILE* tmp_file = fopen(tmp_filename.c_str(), "wb");
     bool opened = SyscallErrorInfo(tmp_file != NULL,
@@ -121,15 +373,16 @@ bool PersistentFileUpdate(const char* filename, const void* new_contents, int ne
     if (!tmp_file) {
         return false;
     }
-    bool written = SyscallErrorInfo(new_contents_len == fwrite(new_contents, 1, new_contents_len, tmp_file),
+    bool written = SyscallErrorInfo((size_t)new_contents_len == fwrite(new_contents, 1, new_contents_len, tmp_file),
         "fwrite of new_contents to tmp_file failed"); //TODO include more info
-    bool flushed = SyscallErrorInfo(0 == fflush(tmp_file),
-        "Error: fflush failed to push all writes to disk, ");
+    bool flushed = SyscallErrorInfo(SyncFile(tmp_file),
+        "Error: fsync failed to push all writes to disk, ");
     bool closed = SyscallErrorInfo(0 == fclose(tmp_file), "fclose of tmp_file failed"); //TODO include filename
     if (opened && written && closed && flushed) {
         return SyscallErrorInfo(0 == rename(tmp_filename.c_str(), filename),
-            "rename of tmp_filename to filename failed"); //TODO: include more info
+            "rename of tmp_filename to filename failed") //TODO: include more info
+            && SyscallErrorInfo(SyncDirectory(DirectoryOf(filename)), "fsync of parent directory failed");
     }
-    cwarn("File Update Failed %s, %s, %d", filename, new_contents, new_contents_len);
+    cwarn("File Update Failed %s, %d", filename, new_contents_len);
     return false;
-}
\ No newline at end of file
+}
@@ -2,6 +2,12 @@
 #define YSP_UTILITY_H_
 
 #include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iterator>
+#include <cstdio>
+#include <stdint.h>
 
 #define ARRAR_SIZE(_A) (sizeof(_A)/sizeof(_A[0]))
 
@@ -59,8 +65,121 @@ private:
 #endif
 
 void printMemory(const char *buf, int len);
+bool PersistentFileUpdate(const char* filename, const void* new_contents, int new_contents_len);
+const std::vector<std::string> StringSplit(const std::string& str, std::string delim);
+std::string PadRight(std::string const& str, size_t size);
+std::string PadLeft(std::string const& str, size_t size);
+void LeftTrim(std::string& str);
+void RightTrim(std::string& str);
+void Trim(std::string& str);
 
 namespace utility{
+/*
+durable write primitives, shared by PersistentFileUpdate and DurableFileWriter.
+the temp file lives next to the target so that the final rename never crosses
+a filesystem.
+*/
+std::string TempFileName(const std::string& strFileName);
+std::string DirectoryOf(const std::string& strFileName);
+bool SyncFile(FILE* pFile);                         // fflush + fsync, data reaches the disk
+bool SyncDirectory(const std::string& strDirName);  // make a rename inside the directory durable
+
+/*
+hex dump, 16 bytes per line, every line is HEXDUMP_LINE_LEN chars long except a short last one:
+00007ffc1b2e4a10 - 48 65 6c 6c 6f 2c 20 77 6f 72 6c 64 21 0a 00 00  Hello,.world....
+HexDump() formats into the caller's buffer through lookup tables and only emits whole lines,
+so a small buffer can be drained in a loop. HexDumpToFile() issues one fwrite per 4KB of input.
+*/
+const size_t HEXDUMP_BYTES_PER_LINE = 16;
+const size_t HEXDUMP_LINE_LEN = 16 + 2 + HEXDUMP_BYTES_PER_LINE * 3 + 2 + HEXDUMP_BYTES_PER_LINE + 1;
+size_t HexDumpSize(size_t uLen);    // output length for uLen bytes of input
+size_t HexDump(char* pcOut, size_t uOutLen, const void* pvData, size_t uLen, uintptr_t uAddr);
+bool HexDumpToFile(FILE* pFile, const void* pvData, size_t uLen, uintptr_t uAddr);
+
+/*
+allocation-free counterparts of StringSplit/Trim/Pad, the results are views into the input
+------------------HOW TO USE IT
+for (std::string_view svField : utility::Split(svLine, ", ")) {
+    svField = utility::TrimView(svField);
+    ...
+}
+*/
+size_t FindDelimiter(std::string_view svText, std::string_view svDelim, size_t uPos);  // memchr on the first char, npos if none
+std::string_view LeftTrimView(std::string_view svText);
+std::string_view RightTrimView(std::string_view svText);
+std::string_view TrimView(std::string_view svText);
+void PadLeftInto(std::string& strOut, std::string_view svText, size_t uSize);   // appends, reuses strOut's capacity
+void PadRightInto(std::string& strOut, std::string_view svText, size_t uSize);
+
+class SplitView
+{
+public:
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::string_view          value_type;
+        typedef std::ptrdiff_t            difference_type;
+        typedef const std::string_view*   pointer;
+        typedef const std::string_view&   reference;
+
+        iterator() : m_pinstView_(nullptr), m_uStart_(0), m_uEnd_(0) { }
+        iterator(const SplitView* pinstView, size_t uStart) :
+            m_pinstView_(pinstView),
+            m_uStart_(uStart),
+            m_uEnd_(pinstView->__nextDelimiter(uStart))
+        {
+            m_svToken_ = m_pinstView_->m_svText_.substr(m_uStart_, m_uEnd_ - m_uStart_);
+        }
+
+        reference operator*() const { return m_svToken_; }
+        pointer operator->() const { return &m_svToken_; }
+        iterator& operator++()
+        {
+            if (m_uEnd_ == std::string_view::npos) {
+                m_pinstView_ = nullptr;     // that was the last token
+                return *this;
+            }
+            *this = iterator(m_pinstView_, m_uEnd_ + m_pinstView_->m_svDelim_.size());
+            return *this;
+        }
+        iterator operator++(int) { iterator itOld = *this; ++*this; return itOld; }
+        bool operator==(const iterator& itOther) const
+        {
+            return m_pinstView_ == itOther.m_pinstView_ && (m_pinstView_ == nullptr || m_uStart_ == itOther.m_uStart_);
+        }
+        bool operator!=(const iterator& itOther) const { return !(*this == itOther); }
+
+    private:
+        const SplitView *m_pinstView_;  // nullptr once past the last token
+        size_t           m_uStart_;
+        size_t           m_uEnd_;       // npos for the last token
+        std::string_view m_svToken_;
+    };
+
+    SplitView(std::string_view svText, std::string_view svDelim) :
+        m_svText_(svText),
+        m_svDelim_(svDelim)
+    { }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(); }
+
+private:
+    size_t __nextDelimiter(size_t uPos) const
+    {
+        return m_svDelim_.empty() ? std::string_view::npos : FindDelimiter(m_svText_, m_svDelim_, uPos);
+    }
+
+    std::string_view m_svText_;
+    std::string_view m_svDelim_;
+};
+
+/* same tokens as StringSplit: n delimiters give n + 1 fields, empty ones included */
+inline SplitView Split(std::string_view svText, std::string_view svDelim)
+{
+    return SplitView(svText, svDelim);
+}
 
 }   //utility
 
@@ -0,0 +1,106 @@
+#include "auto_tuner.h"
+
+AutoTuner::AutoTuner(const TuneConfig& stConfig, unsigned int uStartWorkers):
+	m_stConfig(stConfig),
+	m_uCurrent(0),
+	m_uPrevious(0),
+	m_dPrevThroughput(0.0),
+	m_iDirection(1),
+	m_uHold(0)
+{
+	if (m_stConfig.uMinWorkers < 1) {
+		m_stConfig.uMinWorkers = 1;
+	}
+	if (m_stConfig.uMaxWorkers < m_stConfig.uMinWorkers) {
+		m_stConfig.uMaxWorkers = m_stConfig.uMinWorkers;
+	}
+	m_uCurrent = __clamp(uStartWorkers);
+	m_uPrevious = m_uCurrent;
+}
+
+AutoTuner::~AutoTuner()
+{
+}
+
+unsigned int AutoTuner::__clamp(long long llWorkers) const
+{
+	if (llWorkers < (long long)m_stConfig.uMinWorkers) {
+		return m_stConfig.uMinWorkers;
+	}
+	if (llWorkers > (long long)m_stConfig.uMaxWorkers) {
+		return m_stConfig.uMaxWorkers;
+	}
+	return (unsigned int)llWorkers;
+}
+
+/**
+Function:	step()
+@brief      One round of the hill climb. The reading belongs to m_uCurrent workers and is compared
+            with the one of m_uPrevious; when both are the same count the next probe is made.
+@param[in]  ullTimeMs:for the history, dThroughput:tasks/s, dUtilization:0..1, uQueued:tasks waiting
+@param[out] None
+@return     worker count for the next interval
+*/
+unsigned int AutoTuner::step(unsigned long long ullTimeMs, double dThroughput, double dUtilization, size_t uQueued)
+{
+	TuneDecision_E eDecision;
+	unsigned int uNext = m_uCurrent;
+	double dNoise = m_stConfig.uNoisePercent / 100.0;
+
+	if (uQueued == 0 && dUtilization < 0.5) {
+		eDecision = TUNE_IDLE;
+		uNext = __clamp((long long)m_uCurrent - 1);
+		m_iDirection = 1;	//once work backs up, more workers is the likely answer
+		m_uHold = 0;
+	}
+	else if (m_uHold > 0) {
+		eDecision = TUNE_HOLD;
+		m_uHold--;
+	}
+	else if (m_uCurrent == m_uPrevious) {
+		eDecision = TUNE_CLIMB;
+		uNext = __clamp((long long)m_uCurrent + m_iDirection);
+		if (uNext == m_uCurrent) {
+			m_iDirection = -m_iDirection;	//against a bound, probe the other side
+			uNext = __clamp((long long)m_uCurrent + m_iDirection);
+		}
+	}
+	else {
+		int iMoved = m_uCurrent > m_uPrevious ? 1 : -1;
+		double dGain = (dThroughput - m_dPrevThroughput) / (m_dPrevThroughput > 1.0 ? m_dPrevThroughput : 1.0);
+		if (dGain > dNoise) {
+			eDecision = TUNE_CLIMB;
+			m_iDirection = iMoved;
+			uNext = __clamp((long long)m_uCurrent + m_iDirection);
+		}
+		else if (dGain < -dNoise) {
+			eDecision = TUNE_REVERSE;
+			m_iDirection = -iMoved;
+			uNext = m_uPrevious;
+			m_uHold = m_stConfig.uHoldIntervals;
+		}
+		else {
+			eDecision = TUNE_SETTLE;
+			m_iDirection = -1;		//prefer fewer: the next probe looks below
+			uNext = m_uCurrent < m_uPrevious ? m_uCurrent : m_uPrevious;
+			m_uHold = m_stConfig.uHoldIntervals;
+		}
+	}
+
+	TuneSample stSample = { ullTimeMs, m_uCurrent, dThroughput, dUtilization, uQueued, eDecision, uNext };
+	m_qHistory.push_back(stSample);
+	if (m_qHistory.size() > AUTO_TUNE_HISTORY) {
+		m_qHistory.pop_front();
+	}
+
+	//a hold or an idle step starts the next comparison from the count just measured
+	m_uPrevious = (eDecision == TUNE_CLIMB) ? m_uCurrent : uNext;
+	m_dPrevThroughput = dThroughput;
+	m_uCurrent = uNext;
+	return uNext;
+}
+
+std::vector<AutoTuner::TuneSample> AutoTuner::getHistory() const
+{
+	return std::vector<TuneSample>(m_qHistory.begin(), m_qHistory.end());
+}
@@ -0,0 +1,88 @@
+#ifndef AUTO_TUNER_H_
+#define AUTO_TUNER_H_
+
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+#define AUTO_TUNE_HISTORY (64)	//Samples kept for getHistory().
+
+/**
+@class	AutoTuner
+@brief	Hill climbing on the worker count, after the .NET thread pool's controller.
+						   1.every interval the pool reports tasks/s, busy fraction of the active workers and queue depth
+						   2.a move that raised throughput by more than the noise band is repeated in the same direction
+						   3.a move that lowered it is undone and the search turns around; a flat one keeps the fewer workers
+						   4.after undoing a move the count holds for uHoldIntervals before the next probe
+						   5.with an empty queue and idle workers the count steps down, throughput then only says how much work came in
+						   6.not thread-safe, the pool calls it from its controller thread under m_mtxTuner
+@return	None
+-----------------HOW TO USE IT
+	AutoTuner::TuneConfig stConfig;
+	stConfig.uMinWorkers = 2;
+	stConfig.uMaxWorkers = MAX_THREADS;
+	ThreadPool::getInstance()->enableAutoTune(stConfig);
+	...
+	for (auto& stSample : ThreadPool::getInstance()->getAutoTuneHistory()) {
+		printf("%u workers %.0f tasks/s -> %u\n", stSample.uWorkers, stSample.dThroughput, stSample.uNext);
+	}
+*/
+class AutoTuner
+{
+public:
+	typedef enum tagTuneDecision
+	{
+		TUNE_CLIMB,		//moved on in the current direction
+		TUNE_REVERSE,	//the last move cost throughput, undone
+		TUNE_SETTLE,	//the last move changed nothing, kept the smaller count
+		TUNE_HOLD,		//waiting out the hold after a reverse or settle
+		TUNE_IDLE		//no backlog, stepped down
+	}TuneDecision_E;
+	typedef struct tagTuneConfig
+	{
+		unsigned int uMinWorkers;
+		unsigned int uMaxWorkers;		//clamped to the pool size
+		unsigned int uIntervalMs;		//sampling period
+		unsigned int uNoisePercent;		//throughput changes within this band count as flat
+		unsigned int uHoldIntervals;
+		tagTuneConfig():
+			uMinWorkers(1),
+			uMaxWorkers(0xFFFFFFFFu),
+			uIntervalMs(100),
+			uNoisePercent(5),
+			uHoldIntervals(2)
+		{
+		}
+	}TuneConfig, *PTuneConfig;
+	typedef struct tagTuneSample
+	{
+		unsigned long long ullTimeMs;		//since enableAutoTune()
+		unsigned int       uWorkers;		//active during the interval
+		double             dThroughput;		//tasks per second
+		double             dUtilization;	//busy time over uWorkers * interval, 0..1
+		size_t             uQueued;
+		TuneDecision_E     eDecision;
+		unsigned int       uNext;			//count for the next interval
+	}TuneSample, *PTuneSample;
+
+	AutoTuner(const TuneConfig& stConfig, unsigned int uStartWorkers);
+	~AutoTuner();
+
+	unsigned int step(unsigned long long ullTimeMs, double dThroughput, double dUtilization, size_t uQueued);	//step--feed one interval, returns the next worker count
+	unsigned int getWorkers() const { return m_uCurrent; }
+	const TuneConfig& getConfig() const { return m_stConfig; }
+	std::vector<TuneSample> getHistory() const;
+
+private:
+	unsigned int __clamp(long long llWorkers) const;
+
+	TuneConfig              m_stConfig;
+	unsigned int            m_uCurrent;		//count being measured
+	unsigned int            m_uPrevious;	//count of the interval before, m_uCurrent if it didn't move
+	double                  m_dPrevThroughput;
+	int                     m_iDirection;	//+1 or -1
+	unsigned int            m_uHold;
+	std::deque<TuneSample>  m_qHistory;
+};
+
+#endif //AUTO_TUNER_H_
@@ -0,0 +1,72 @@
+#include "channel.h"
+
+ChannelWaitList::ChannelWaitList():
+	m_uParked(0),
+	m_ullNextTicket(0)
+{
+}
+
+ChannelWaitList::~ChannelWaitList()
+{
+}
+
+/**
+Function:	park()
+@brief      Keep a continuation until the next wake(). The caller must check the channel again
+            afterwards: a change made before the park was published is not announced twice.
+@param[in]  pinstPool:pool to resume on, pfnResume/pvArg:the continuation
+@param[out] None
+@return     ticket for cancel()
+*/
+unsigned long long ChannelWaitList::park(ThreadPool* pinstPool, ThreadPool::CallBack_T pfnResume, VOID* pvArg)
+{
+	unsigned long long ullTicket;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxParked);
+		ullTicket = ++m_ullNextTicket;
+		Parked stParked = { pinstPool, pfnResume, pvArg, ullTicket };
+		m_vecParked.push_back(stParked);
+		m_uParked.fetch_add(1);
+	}
+	//pairs with the fence in wake(): either the waker sees us parked or our recheck sees its change
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return ullTicket;
+}
+
+bool ChannelWaitList::cancel(unsigned long long ullTicket)
+{
+	std::lock_guard<std::mutex> guard(m_mtxParked);
+	for (auto itParked = m_vecParked.begin(); itParked != m_vecParked.end(); ++itParked) {
+		if (itParked->ullTicket == ullTicket) {
+			m_vecParked.erase(itParked);
+			m_uParked.fetch_sub(1);
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+Function:	wake()
+@brief      Queue every parked continuation on its pool. Without parked tasks it is a fence and a load.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+VOID ChannelWaitList::wake()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_uParked.load(std::memory_order_relaxed) == 0) {
+		return;
+	}
+
+	std::vector<Parked> vecResume;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxParked);
+		vecResume.swap(m_vecParked);
+		m_uParked.store(0, std::memory_order_relaxed);
+	}
+	for (auto& stParked : vecResume) {
+		stParked.pinstPool->addTask(stParked.pfnResume, stParked.pvArg, "resume");
+	}
+}
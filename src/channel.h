@@ -0,0 +1,344 @@
+#ifndef CHANNEL_H_
+#define CHANNEL_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+#define CHANNEL_CACHE_LINE (64)	//Producer and consumer indices live on separate lines of this size.
+
+/**
+@class	ChannelWaitList
+@brief	Tasks parked on a channel until the other side makes progress.
+						   1.park() keeps the continuation, wake() queues every parked one on its pool
+						   2.wake() costs one fence and one load while nobody is parked
+						   3.a task parks, rechecks the channel and returns; it never sleeps on a worker
+@return	None
+*/
+class ChannelWaitList
+{
+public:
+	ChannelWaitList();
+	~ChannelWaitList();
+
+	ChannelWaitList(const ChannelWaitList&) = delete;
+	ChannelWaitList& operator= (const ChannelWaitList&) = delete;
+
+	unsigned long long park(ThreadPool* pinstPool, ThreadPool::CallBack_T pfnResume, VOID* pvArg);	//park--returns a ticket for cancel()
+	bool cancel(unsigned long long ullTicket);	//cancel--false if the continuation was already queued
+	VOID wake();		//wake--call after the change the parked tasks wait for is visible
+
+private:
+	typedef struct tagParked
+	{
+		ThreadPool            *pinstPool;
+		ThreadPool::CallBack_T pfnResume;
+		VOID                  *pvArg;
+		unsigned long long     ullTicket;
+	}Parked, *PParked;
+
+	std::atomic<UINT>   m_uParked;
+	unsigned long long  m_ullNextTicket;	//guarded by m_mtxParked
+	std::mutex          m_mtxParked;
+	std::vector<Parked> m_vecParked;
+};
+
+/*
+Shared part of the channels: parking on empty/full, written once for every ring below.
+CHANNEL_T must provide trySend(T&&), tryRecv(T&), hasItem() and hasRoom().
+A parked task is queued exactly once and never runs while its parker goes on with an item,
+so even a single-consumer channel keeps a single consumer.
+*/
+template <typename CHANNEL_T, typename T>
+class ChannelParking
+{
+public:
+	/**
+	Function:	recvOrPark()
+	@brief      Receive one item, or park pfnResume to be queued on pinstPool once an item arrives.
+	            The task calling it should return after a false and retry when resumed.
+	@param[in]  pinstPool/pfnResume/pvArg:the continuation
+	@param[out] tItem:received item
+	@return     true if tItem was received
+	*/
+	bool recvOrPark(T& tItem, ThreadPool* pinstPool, ThreadPool::CallBack_T pfnResume, VOID* pvArg)
+	{
+		CHANNEL_T* pinstSelf = static_cast<CHANNEL_T*>(this);
+		if (pinstSelf->tryRecv(tItem)) {
+			return true;
+		}
+		unsigned long long ullTicket = m_instRecvWait.park(pinstPool, pfnResume, pvArg);
+		//an item sent between the first try and park() found nobody to wake
+		if (pinstSelf->hasItem() && m_instRecvWait.cancel(ullTicket)) {
+			return pinstSelf->tryRecv(tItem) ||
+				   recvOrPark(tItem, pinstPool, pfnResume, pvArg);	//taken by another receiver meanwhile
+		}
+		return false;
+	}
+
+	/**
+	Function:	sendOrPark()
+	@brief      Send one item, or keep it with the caller and park pfnResume until there is room.
+	@param[in]  tItem:moved from only on success, pinstPool/pfnResume/pvArg:the continuation
+	@param[out] None
+	@return     true if tItem was sent
+	*/
+	bool sendOrPark(T&& tItem, ThreadPool* pinstPool, ThreadPool::CallBack_T pfnResume, VOID* pvArg)
+	{
+		CHANNEL_T* pinstSelf = static_cast<CHANNEL_T*>(this);
+		if (pinstSelf->trySend(std::move(tItem))) {
+			return true;
+		}
+		unsigned long long ullTicket = m_instSendWait.park(pinstPool, pfnResume, pvArg);
+		if (pinstSelf->hasRoom() && m_instSendWait.cancel(ullTicket)) {
+			return pinstSelf->trySend(std::move(tItem)) ||
+				   sendOrPark(std::move(tItem), pinstPool, pfnResume, pvArg);
+		}
+		return false;
+	}
+
+protected:
+	ChannelWaitList m_instRecvWait;		//receivers waiting for an item
+	ChannelWaitList m_instSendWait;		//senders waiting for room
+};
+
+/**
+@class	SpscChannel
+@brief	Bounded ring for one sending and one receiving thread at a time.
+						   1.no read-modify-write at all: each side owns one index and caches the other's,
+						     so it touches the shared line only when its cached view runs out
+						   2.indices and caches sit on separate cache lines
+						   3.batch calls publish the whole batch with one store
+@return	None
+-----------------HOW TO USE IT
+	SpscChannel<PRecord> instChan(1024);
+	//producer                                 //consumer
+	instChan.trySend(pRecord);                  PRecord apBatch[32];
+	                                            UINT uGot = instChan.tryRecvBatch(apBatch, 32);
+*/
+template <typename T>
+class SpscChannel : public ChannelParking<SpscChannel<T>, T>
+{
+public:
+	explicit SpscChannel(size_t uCapacity) :
+		m_uMask(__roundUp(uCapacity) - 1),
+		m_pSlots(new T[m_uMask + 1]),
+		m_uTail(0),
+		m_uHeadCache(0),
+		m_uHead(0),
+		m_uTailCache(0)
+	{
+	}
+
+	SpscChannel(const SpscChannel&) = delete;
+	SpscChannel& operator= (const SpscChannel&) = delete;
+
+	size_t capacity() const { return m_uMask + 1; }
+
+	bool trySend(T&& tItem) { return trySendBatch(&tItem, 1) == 1; }
+	bool trySend(const T& tItem) { T tCopy(tItem); return trySend(std::move(tCopy)); }
+	bool tryRecv(T& tItem) { return tryRecvBatch(&tItem, 1) == 1; }
+	bool hasItem() const { return m_uTail.load(std::memory_order_acquire) != m_uHead.load(std::memory_order_acquire); }
+	bool hasRoom() const { return m_uTail.load(std::memory_order_acquire) - m_uHead.load(std::memory_order_acquire) < capacity(); }
+
+	UINT trySendBatch(T* ptItems, UINT uCount)	//trySendBatch--move up to uCount items in, returns how many
+	{
+		size_t uTail = m_uTail.load(std::memory_order_relaxed);
+		if (uTail + uCount - m_uHeadCache > capacity()) {
+			m_uHeadCache = m_uHead.load(std::memory_order_acquire);
+		}
+		size_t uFree = capacity() - (uTail - m_uHeadCache);
+		UINT uSend = uCount < uFree ? uCount : (UINT)uFree;
+		for (UINT i = 0; i < uSend; ++i) {
+			m_pSlots[(uTail + i) & m_uMask] = std::move(ptItems[i]);
+		}
+		if (uSend > 0) {
+			m_uTail.store(uTail + uSend, std::memory_order_release);
+			this->m_instRecvWait.wake();
+		}
+		return uSend;
+	}
+
+	UINT tryRecvBatch(T* ptItems, UINT uCount)	//tryRecvBatch--move up to uCount items out, returns how many
+	{
+		size_t uHead = m_uHead.load(std::memory_order_relaxed);
+		if (m_uTailCache - uHead < uCount) {
+			m_uTailCache = m_uTail.load(std::memory_order_acquire);
+		}
+		size_t uReady = m_uTailCache - uHead;
+		UINT uRecv = uCount < uReady ? uCount : (UINT)uReady;
+		for (UINT i = 0; i < uRecv; ++i) {
+			ptItems[i] = std::move(m_pSlots[(uHead + i) & m_uMask]);
+		}
+		if (uRecv > 0) {
+			m_uHead.store(uHead + uRecv, std::memory_order_release);
+			this->m_instSendWait.wake();
+		}
+		return uRecv;
+	}
+
+private:
+	static size_t __roundUp(size_t uCapacity)
+	{
+		size_t uSize = 2;
+		while (uSize < uCapacity) {
+			uSize <<= 1;
+		}
+		return uSize;
+	}
+
+	const size_t                                  m_uMask;
+	std::unique_ptr<T[]>                          m_pSlots;
+	alignas(CHANNEL_CACHE_LINE) std::atomic<size_t> m_uTail;	//producer's line
+	size_t                                        m_uHeadCache;
+	alignas(CHANNEL_CACHE_LINE) std::atomic<size_t> m_uHead;	//consumer's line
+	size_t                                        m_uTailCache;
+	char                                          m_acPad[CHANNEL_CACHE_LINE - sizeof(size_t)];
+};
+
+/**
+@class	SeqRingChannel
+@brief	Bounded ring for many senders, and one (MpscChannel) or many (MpmcChannel) receivers.
+						   1.every slot carries a sequence number telling which lap may write or read it,
+						     so a claimed index is the only thing the sides contend on
+						   2.batch calls claim as many consecutive ready slots as they can with one CAS
+						   3.with a single receiver the head is advanced by a plain store
+@return	None
+-----------------HOW TO USE IT
+	MpmcChannel<Job> instJobs(4096);
+	instJobs.trySend(std::move(stJob));		//from any thread
+	Job stJob;
+	if (!instJobs.recvOrPark(stJob, ThreadPool::getInstance(), fnConsume, pvCtx)) {
+		return 0;		//fnConsume is queued again when a job arrives
+	}
+*/
+template <typename T, bool bMultiConsumer>
+class SeqRingChannel : public ChannelParking<SeqRingChannel<T, bMultiConsumer>, T>
+{
+public:
+	explicit SeqRingChannel(size_t uCapacity) :
+		m_uMask(__roundUp(uCapacity) - 1),
+		m_pSlots(new Slot[m_uMask + 1]),
+		m_uTail(0),
+		m_uHead(0)
+	{
+		for (size_t i = 0; i <= m_uMask; ++i) {
+			m_pSlots[i].uSeq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	SeqRingChannel(const SeqRingChannel&) = delete;
+	SeqRingChannel& operator= (const SeqRingChannel&) = delete;
+
+	size_t capacity() const { return m_uMask + 1; }
+
+	bool trySend(T&& tItem) { return trySendBatch(&tItem, 1) == 1; }
+	bool trySend(const T& tItem) { T tCopy(tItem); return trySend(std::move(tCopy)); }
+	bool tryRecv(T& tItem) { return tryRecvBatch(&tItem, 1) == 1; }
+	bool hasItem() { size_t uPos = m_uHead.load(std::memory_order_acquire); return __countReady(uPos, 1, 1) == 1; }
+	bool hasRoom() { size_t uPos = m_uTail.load(std::memory_order_acquire); return __countReady(uPos, 1, 0) == 1; }
+
+	UINT trySendBatch(T* ptItems, UINT uCount)
+	{
+		size_t uPos = m_uTail.load(std::memory_order_relaxed);
+		UINT uClaim;
+		while (true) {
+			uClaim = __countReady(uPos, uCount, 0);
+			if (uClaim == 0) {
+				//the slot at uPos is still full, or another sender moved on
+				size_t uNow = m_uTail.load(std::memory_order_relaxed);
+				if (uNow == uPos) {
+					return 0;
+				}
+				uPos = uNow;
+				continue;
+			}
+			if (m_uTail.compare_exchange_weak(uPos, uPos + uClaim, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		for (UINT i = 0; i < uClaim; ++i) {
+			Slot& stSlot = m_pSlots[(uPos + i) & m_uMask];
+			stSlot.tValue = std::move(ptItems[i]);
+			stSlot.uSeq.store(uPos + i + 1, std::memory_order_release);
+		}
+		this->m_instRecvWait.wake();
+		return uClaim;
+	}
+
+	UINT tryRecvBatch(T* ptItems, UINT uCount)
+	{
+		size_t uPos = m_uHead.load(std::memory_order_relaxed);
+		UINT uClaim;
+		while (true) {
+			uClaim = __countReady(uPos, uCount, 1);
+			if (uClaim == 0) {
+				size_t uNow = m_uHead.load(std::memory_order_relaxed);
+				if (uNow == uPos) {
+					return 0;
+				}
+				uPos = uNow;
+				continue;
+			}
+			if (!bMultiConsumer) {
+				m_uHead.store(uPos + uClaim, std::memory_order_relaxed);
+				break;
+			}
+			if (m_uHead.compare_exchange_weak(uPos, uPos + uClaim, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		for (UINT i = 0; i < uClaim; ++i) {
+			Slot& stSlot = m_pSlots[(uPos + i) & m_uMask];
+			ptItems[i] = std::move(stSlot.tValue);
+			stSlot.uSeq.store(uPos + i + m_uMask + 1, std::memory_order_release);
+		}
+		this->m_instSendWait.wake();
+		return uClaim;
+	}
+
+private:
+	typedef struct tagSlot
+	{
+		std::atomic<size_t> uSeq;	//== pos: free for the sender of pos, == pos+1: holds the item of pos
+		T                   tValue;
+	}Slot, *PSlot;
+
+	/* consecutive slots from uPos in the wanted state, uLag 0 for free and 1 for filled */
+	UINT __countReady(size_t uPos, UINT uCount, size_t uLag)
+	{
+		UINT uReady = 0;
+		while (uReady < uCount &&
+			   m_pSlots[(uPos + uReady) & m_uMask].uSeq.load(std::memory_order_acquire) == uPos + uReady + uLag) {
+			++uReady;
+		}
+		return uReady;
+	}
+
+	static size_t __roundUp(size_t uCapacity)
+	{
+		size_t uSize = 2;
+		while (uSize < uCapacity) {
+			uSize <<= 1;
+		}
+		return uSize;
+	}
+
+	const size_t                                    m_uMask;
+	std::unique_ptr<Slot[]>                         m_pSlots;
+	alignas(CHANNEL_CACHE_LINE) std::atomic<size_t> m_uTail;	//senders' line
+	alignas(CHANNEL_CACHE_LINE) std::atomic<size_t> m_uHead;	//receivers' line
+	char                                            m_acPad[CHANNEL_CACHE_LINE - sizeof(size_t)];
+};
+
+template <typename T>
+using MpscChannel = SeqRingChannel<T, false>;
+template <typename T>
+using MpmcChannel = SeqRingChannel<T, true>;
+
+#endif //CHANNEL_H_
@@ -0,0 +1,193 @@
+#include "durable_writer.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include "../include/utility.h"
+
+/**
+Function:	DurableFileWriter()
+@brief      Constructor of DurableFileWriter.
+@param[in]  pinstPool:the pool which runs the commits
+@param[out] None
+@return     None
+*/
+DurableFileWriter::DurableFileWriter(ThreadPool* pinstPool):
+	m_pinstPool(pinstPool),
+	m_bCommitting(false),
+	m_bAllOk(true),
+	m_ullCommits(0),
+	m_ullUpdates(0)
+{
+}
+
+/**
+Function:	~DurableFileWriter()
+@brief      Destructor of DurableFileWriter. Pending updates are committed first.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+DurableFileWriter::~DurableFileWriter()
+{
+	flush();
+}
+
+/**
+Function:	update()
+@brief      Queue new contents of a file. If the file already has an update waiting
+            for the next group, the contents are replaced and both callers share one result.
+@param[in]  strFileName:target file, strContents:the whole new contents
+@param[out] None
+@return     future which turns true when the contents are durable
+*/
+DurableFileWriter::Result_T DurableFileWriter::update(const std::string& strFileName, std::string strContents)
+{
+	bool bSchedule = false;
+	Result_T futResult;
+
+	m_ullUpdates++;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxPending);
+		PendingUpdate& stUpdate = m_mapPending[strFileName];
+		stUpdate.strContents.swap(strContents);
+		if (!stUpdate.pPromise) {
+			stUpdate.pPromise = std::make_shared<std::promise<bool>>();
+			stUpdate.futResult = stUpdate.pPromise->get_future().share();
+		}
+		futResult = stUpdate.futResult;
+
+		if (!m_bCommitting) {
+			m_bCommitting = true;
+			bSchedule = true;
+		}
+	}
+
+	if (bSchedule) {
+		m_pinstPool->addTask(std::bind(&DurableFileWriter::__commitWorker, this, std::placeholders::_1), nullptr);
+	}
+	return futResult;
+}
+
+DurableFileWriter::Result_T DurableFileWriter::update(const std::string& strFileName, const VOID* pvData, size_t uLen)
+{
+	return update(strFileName, std::string((const char*)pvData, uLen));
+}
+
+/**
+Function:	flush()
+@brief      Wait until every update queued so far is committed.
+@param[in]  None
+@param[out] None
+@return     false if any commit failed since the last flush
+*/
+bool DurableFileWriter::flush()
+{
+	std::unique_lock<std::mutex> uLocker(m_mtxPending);
+	m_condIdle.wait(uLocker, [this] { return !m_bCommitting; });
+
+	bool bAllOk = m_bAllOk;
+	m_bAllOk = true;
+	return bAllOk;
+}
+
+/**
+Function:	__commitWorker()
+@brief      Only one commit task exists at a time, which keeps the updates of one file in order.
+            Everything that piled up while a group was syncing becomes the next group.
+@param[in]  pvArg:unused
+@param[out] None
+@return     0
+*/
+int DurableFileWriter::__commitWorker(VOID* pvArg)
+{
+	(void)pvArg;
+	Batch_T mapBatch;
+
+	while (true) {
+		{
+			std::lock_guard<std::mutex> guard(m_mtxPending);
+			if (m_mapPending.empty()) {
+				m_bCommitting = false;
+				m_condIdle.notify_all();
+				return 0;
+			}
+			mapBatch.swap(m_mapPending);
+		}
+
+		__commitBatch(mapBatch);
+		mapBatch.clear();
+		m_ullCommits++;
+	}
+}
+
+/**
+Function:	__commitBatch()
+@brief      Commit one group: write all temp files, fsync them, rename them into place,
+            then fsync every parent directory once.
+@param[in]  mapBatch:file name -> contents
+@param[out] None
+@return     None
+*/
+VOID DurableFileWriter::__commitBatch(Batch_T& mapBatch)
+{
+	typedef struct tagStaged
+	{
+		const std::string *pstrFileName;
+		PPendingUpdate     pUpdate;
+		std::string        strTmpName;
+		FILE              *pFile;
+		bool               bOk;
+	}Staged;
+
+	std::vector<Staged> vecStaged;
+	vecStaged.reserve(mapBatch.size());
+
+	//1. write every temp file, nothing reaches the disk yet
+	for (auto& kv : mapBatch) {
+		Staged stStaged = { &kv.first, &kv.second, utility::TempFileName(kv.first), nullptr, false };
+		stStaged.pFile = fopen(stStaged.strTmpName.c_str(), "wb");
+		if (stStaged.pFile != nullptr) {
+			const std::string& strContents = kv.second.strContents;
+			stStaged.bOk = (strContents.size() == fwrite(strContents.data(), 1, strContents.size(), stStaged.pFile));
+		}
+		vecStaged.push_back(stStaged);
+	}
+
+	//2. one fsync per file for the whole group
+	for (auto& stStaged : vecStaged) {
+		if (stStaged.pFile == nullptr) {
+			continue;
+		}
+		stStaged.bOk = utility::SyncFile(stStaged.pFile) && stStaged.bOk;
+		stStaged.bOk = (0 == fclose(stStaged.pFile)) && stStaged.bOk;
+	}
+
+	//3. publish, then make the renames durable once per directory
+	std::unordered_map<std::string, bool> mapDirs;
+	for (auto& stStaged : vecStaged) {
+		if (stStaged.bOk) {
+			stStaged.bOk = (0 == rename(stStaged.strTmpName.c_str(), stStaged.pstrFileName->c_str()));
+		}
+		if (stStaged.bOk) {
+			mapDirs.emplace(utility::DirectoryOf(*stStaged.pstrFileName), true);
+		}
+	}
+	for (auto& kv : mapDirs) {
+		kv.second = utility::SyncDirectory(kv.first);
+	}
+
+	bool bAllOk = true;
+	for (auto& stStaged : vecStaged) {
+		if (stStaged.bOk) {
+			stStaged.bOk = mapDirs[utility::DirectoryOf(*stStaged.pstrFileName)];
+		}
+		bAllOk = bAllOk && stStaged.bOk;
+		stStaged.pUpdate->pPromise->set_value(stStaged.bOk);
+	}
+
+	if (!bAllOk) {
+		std::lock_guard<std::mutex> guard(m_mtxPending);
+		m_bAllOk = false;
+	}
+}
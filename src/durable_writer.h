@@ -0,0 +1,70 @@
+#ifndef DURABLE_WRITER_H_
+#define DURABLE_WRITER_H_
+
+#include <string>
+#include <memory>
+#include <future>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+
+#include "thread_pool.h"
+
+/**
+@class	DurableFileWriter
+@brief	Asynchronous version of PersistentFileUpdate, run on the thread pool.
+						   1.updates of the same file are coalesced, the last write wins
+						   2.one commit writes every pending file, fsyncs them as a group,
+						     renames them into place and fsyncs each parent directory once
+						   3.updates arriving while a commit is in flight form the next group
+@return	None
+-----------------HOW TO USE IT
+	DurableFileWriter instWriter;	//default to ThreadPool::getInstance()
+
+	std::shared_future<bool> fut = instWriter.update("state.bin", strSnapshot);
+	...
+	fut.get();			//true once "state.bin" holds strSnapshot (or a later one) on disk
+
+	instWriter.flush();	//wait for everything submitted so far
+*/
+class DurableFileWriter
+{
+public:
+	typedef std::shared_future<bool> Result_T;
+
+	explicit DurableFileWriter(ThreadPool* pinstPool = ThreadPool::getInstance());
+	~DurableFileWriter();
+
+	DurableFileWriter(const DurableFileWriter&) = delete;
+	DurableFileWriter& operator= (const DurableFileWriter&) = delete;
+
+	Result_T update(const std::string& strFileName, std::string strContents);	//update--queue new contents of a file
+	Result_T update(const std::string& strFileName, const VOID* pvData, size_t uLen);
+	bool flush();		//flush--wait until every queued update is committed, false if any failed
+
+	unsigned long long getCommitCount() const { return m_ullCommits.load(); }	//groups committed so far
+	unsigned long long getUpdateCount() const { return m_ullUpdates.load(); }	//updates accepted so far
+
+private:
+	typedef struct tagPendingUpdate
+	{
+		std::string                          strContents;
+		std::shared_ptr<std::promise<bool>>  pPromise;
+		Result_T                             futResult;
+	}PendingUpdate, *PPendingUpdate;
+	typedef std::unordered_map<std::string, PendingUpdate> Batch_T;
+
+	int  __commitWorker(VOID* pvArg);	//__commitWorker--drain pending groups until none is left
+	VOID __commitBatch(Batch_T& mapBatch);
+
+	ThreadPool                          *m_pinstPool;
+	std::mutex                           m_mtxPending;
+	std::condition_variable              m_condIdle;
+	Batch_T                              m_mapPending;	//file name -> newest contents not yet committed
+	bool                                 m_bCommitting;	//a commit task is queued or running
+	bool                                 m_bAllOk;		//no failure since the last flush
+	std::atomic<unsigned long long>      m_ullCommits;
+	std::atomic<unsigned long long>      m_ullUpdates;
+};
+
+#endif //DURABLE_WRITER_H_
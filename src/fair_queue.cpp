@@ -0,0 +1,174 @@
+#include "fair_queue.h"
+
+#include <chrono>
+
+FairTaskQueue::FairTaskQueue():
+	m_uCursor(0),
+	m_uQueued(0)
+{
+	tenant(FAIR_QUEUE_DEFAULT_TENANT);
+}
+
+FairTaskQueue::~FairTaskQueue()
+{
+}
+
+unsigned long long FairTaskQueue::nowNs()
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FairTaskQueue::PTenant FairTaskQueue::tenant(unsigned int uId)
+{
+	//the default tenant is always first, most pools have no other
+	for (auto& pstTenant : m_vecTenants) {
+		if (pstTenant->uId == uId) {
+			return pstTenant.get();
+		}
+	}
+
+	std::unique_ptr<Tenant> pstTenant(new Tenant());
+	pstTenant->uId = uId;
+	pstTenant->uWeight = 1;
+	pstTenant->uMaxRunning = 0;
+	pstTenant->llDeficit = 0;
+	pstTenant->bActive = false;
+	pstTenant->uRunning.store(0);
+	pstTenant->ullCompleted.store(0);
+	pstTenant->ullSubmitted = 0;
+	pstTenant->ullStarted = 0;
+	pstTenant->ullWaitNsTotal = 0;
+	pstTenant->ullWaitNsMax = 0;
+	m_vecTenants.push_back(std::move(pstTenant));
+	return m_vecTenants.back().get();
+}
+
+void FairTaskQueue::setTenant(unsigned int uId, unsigned int uWeight, unsigned int uMaxRunning)
+{
+	PTenant pstTenant = tenant(uId);
+	pstTenant->uWeight = uWeight < 1 ? 1 : uWeight;
+	pstTenant->uMaxRunning = uMaxRunning;
+}
+
+void FairTaskQueue::pushBack(PTenant pstTenant, void* pvItem, unsigned long long ullNowNs)
+{
+	pstTenant->qItems.emplace_back(pvItem, ullNowNs);
+	pstTenant->ullSubmitted++;
+	m_uQueued++;
+	__activate(pstTenant);
+}
+
+/**
+Function:	pushFront()
+@brief      Undo popNext() for an item that never ran. Its wait restarts at ullNowNs, the part
+            already waited stays in the statistics.
+@param[in]  pstTenant:tenant popNext() returned, pvItem:the item, ullNowNs:nowNs()
+@param[out] None
+@return     None
+*/
+void FairTaskQueue::pushFront(PTenant pstTenant, void* pvItem, unsigned long long ullNowNs)
+{
+	pstTenant->qItems.emplace_front(pvItem, ullNowNs);
+	pstTenant->ullStarted--;
+	pstTenant->uRunning--;
+	m_uQueued++;
+	__activate(pstTenant);
+}
+
+/**
+Function:	popNext()
+@brief      Deficit round robin with a cost of one per task: a tenant whose turn starts gets its
+            weight added to the deficit and is served until the deficit is used up or it runs dry.
+            Capped tenants are passed over without losing their turn's remainder.
+@param[in]  ullNowNs:nowNs(), for the wait statistics
+@param[out] ppstTenant:tenant of the item
+@return     the item, nullptr if nothing is runnable
+*/
+void* FairTaskQueue::popNext(PTenant* ppstTenant, unsigned long long ullNowNs)
+{
+	for (size_t uVisited = 0; uVisited < m_vecActive.size(); ) {
+		if (m_uCursor >= m_vecActive.size()) {
+			m_uCursor = 0;
+		}
+		PTenant pstTenant = m_vecActive[m_uCursor];
+		if (pstTenant->qItems.empty()) {
+			//ran dry: leaves the round, an idle tenant doesn't save up credit
+			pstTenant->bActive = false;
+			pstTenant->llDeficit = 0;
+			m_vecActive.erase(m_vecActive.begin() + (ptrdiff_t)m_uCursor);
+			continue;
+		}
+		if (pstTenant->uMaxRunning != 0 && pstTenant->uRunning.load() >= pstTenant->uMaxRunning) {
+			++m_uCursor;
+			++uVisited;
+			continue;
+		}
+		if (pstTenant->llDeficit < 1) {
+			pstTenant->llDeficit += pstTenant->uWeight;
+		}
+
+		std::pair<void*, unsigned long long> pairItem = pstTenant->qItems.front();
+		pstTenant->qItems.pop_front();
+		m_uQueued--;
+		pstTenant->llDeficit--;
+		pstTenant->uRunning++;
+		pstTenant->ullStarted++;
+		unsigned long long ullWaitNs = ullNowNs > pairItem.second ? ullNowNs - pairItem.second : 0;
+		pstTenant->ullWaitNsTotal += ullWaitNs;
+		if (ullWaitNs > pstTenant->ullWaitNsMax) {
+			pstTenant->ullWaitNsMax = ullWaitNs;
+		}
+		if (pstTenant->llDeficit < 1) {
+			++m_uCursor;
+		}
+		*ppstTenant = pstTenant;
+		return pairItem.first;
+	}
+	return nullptr;
+}
+
+bool FairTaskQueue::finish(PTenant pstTenant)
+{
+	pstTenant->ullCompleted++;
+	pstTenant->uRunning--;
+	return pstTenant->uMaxRunning != 0;
+}
+
+bool FairTaskQueue::hasRunnable() const
+{
+	if (m_uQueued == 0) {
+		return false;
+	}
+	for (PTenant pstTenant : m_vecActive) {
+		if (!pstTenant->qItems.empty() &&
+			(pstTenant->uMaxRunning == 0 || pstTenant->uRunning.load() < pstTenant->uMaxRunning)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+FairTaskQueue::TenantStats FairTaskQueue::getStats(unsigned int uId)
+{
+	PTenant pstTenant = tenant(uId);
+	TenantStats stStats;
+	stStats.ullSubmitted = pstTenant->ullSubmitted;
+	stStats.ullStarted = pstTenant->ullStarted;
+	stStats.ullCompleted = pstTenant->ullCompleted.load();
+	stStats.ullWaitNsTotal = pstTenant->ullWaitNsTotal;
+	stStats.ullWaitNsMax = pstTenant->ullWaitNsMax;
+	stStats.uQueued = pstTenant->qItems.size();
+	stStats.uRunning = pstTenant->uRunning.load();
+	stStats.uWeight = pstTenant->uWeight;
+	stStats.uMaxRunning = pstTenant->uMaxRunning;
+	return stStats;
+}
+
+void FairTaskQueue::__activate(PTenant pstTenant)
+{
+	if (!pstTenant->bActive) {
+		pstTenant->bActive = true;
+		m_vecActive.push_back(pstTenant);
+	}
+}
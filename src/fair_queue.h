@@ -0,0 +1,88 @@
+#ifndef FAIR_QUEUE_H_
+#define FAIR_QUEUE_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#define FAIR_QUEUE_DEFAULT_TENANT (0)	//Tenant of tasks added without one.
+
+/**
+@class	FairTaskQueue
+@brief	The pool's run queue: one FIFO per tenant, served by deficit round robin.
+						   1.every task costs one unit; a tenant's turn serves up to its weight in tasks
+						   2.a tenant with uMaxRunning tasks started is skipped until one finishes
+						   3.wait time (enqueue to start) and throughput are counted per tenant
+						   4.not thread-safe except finish(): the pool calls it with m_mtxTask held
+@return	None
+-----------------HOW TO USE IT
+	ThreadPool::getInstance()->setTenant(TENANT_BATCH, 1, 2);		//weight 1, at most 2 running
+	ThreadPool::getInstance()->setTenant(TENANT_INTERACTIVE, 4);
+	ThreadPool::getInstance()->addTask(TENANT_BATCH, fnReindex, pvShard);
+	ThreadPool::getInstance()->addTask(TENANT_INTERACTIVE, fnQuery, pvReq);
+	FairTaskQueue::TenantStats stStats = ThreadPool::getInstance()->getTenantStats(TENANT_INTERACTIVE);
+*/
+class FairTaskQueue
+{
+public:
+	typedef struct tagTenantStats
+	{
+		unsigned long long ullSubmitted;
+		unsigned long long ullStarted;
+		unsigned long long ullCompleted;
+		unsigned long long ullWaitNsTotal;	//enqueue to start, summed over started tasks
+		unsigned long long ullWaitNsMax;
+		size_t             uQueued;
+		unsigned int       uRunning;
+		unsigned int       uWeight;
+		unsigned int       uMaxRunning;		//0 is unlimited
+	}TenantStats, *PTenantStats;
+
+	typedef struct tagTenant
+	{
+		unsigned int                    uId;
+		unsigned int                    uWeight;
+		unsigned int                    uMaxRunning;
+		long long                       llDeficit;		//tasks left in the current turn
+		bool                            bActive;		//in m_vecActive
+		std::deque<std::pair<void*, unsigned long long>> qItems;	//item, enqueue time in ns
+		std::atomic<unsigned int>       uRunning;
+		std::atomic<unsigned long long> ullCompleted;
+		unsigned long long              ullSubmitted;
+		unsigned long long              ullStarted;
+		unsigned long long              ullWaitNsTotal;
+		unsigned long long              ullWaitNsMax;
+	}Tenant, *PTenant;
+
+	FairTaskQueue();
+	~FairTaskQueue();
+
+	FairTaskQueue(const FairTaskQueue&) = delete;
+	FairTaskQueue& operator= (const FairTaskQueue&) = delete;
+
+	PTenant tenant(unsigned int uId);	//tenant--find or create with weight 1, the pointer stays valid
+	void setTenant(unsigned int uId, unsigned int uWeight, unsigned int uMaxRunning);
+
+	void pushBack(PTenant pstTenant, void* pvItem, unsigned long long ullNowNs);
+	void pushFront(PTenant pstTenant, void* pvItem, unsigned long long ullNowNs);	//pushFront--give back a popped, unstarted item
+	void* popNext(PTenant* ppstTenant, unsigned long long ullNowNs);	//popNext--nullptr if every queued tenant is capped
+	bool finish(PTenant pstTenant);		//finish--a popped item is done; true if the tenant is capped and waiters need a wakeup
+
+	bool hasRunnable() const;
+	size_t size() const { return m_uQueued; }	//queued over all tenants, capped ones included
+	TenantStats getStats(unsigned int uId);
+
+	static unsigned long long nowNs();
+
+private:
+	void __activate(PTenant pstTenant);
+
+	std::vector<std::unique_ptr<Tenant>> m_vecTenants;	//never shrinks, tasks keep raw pointers
+	std::vector<PTenant>                 m_vecActive;		//tenants with queued items, in round-robin order
+	size_t                               m_uCursor;		//whose turn it is in m_vecActive
+	size_t                               m_uQueued;
+};
+
+#endif //FAIR_QUEUE_H_
@@ -0,0 +1,630 @@
+#include "fiber.h"
+
+#ifdef __linux__
+#include <stdint.h>
+#include <unistd.h>
+#include <atomic>
+#include <sys/mman.h>
+#include <thread>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define FIBER_ASAN 1
+#endif
+#if defined(__SANITIZE_THREAD__)
+#define FIBER_TSAN 1
+#endif
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) && !defined(FIBER_ASAN)
+#define FIBER_ASAN 1
+#endif
+#if __has_feature(thread_sanitizer) && !defined(FIBER_TSAN)
+#define FIBER_TSAN 1
+#endif
+#endif
+
+/*the sanitizers keep their own idea of the current stack, they are told about every switch*/
+#ifdef FIBER_ASAN
+extern "C" void __sanitizer_start_switch_fiber(void** ppvFakeStackSave, const void* pvBottom, size_t uSize);
+extern "C" void __sanitizer_finish_switch_fiber(void* pvFakeStackSave, const void** ppvBottomOld, size_t* puSizeOld);
+extern "C" void __asan_unpoison_memory_region(void const volatile* pvAddr, size_t uSize);
+#endif
+#ifdef FIBER_TSAN
+extern "C" void* __tsan_get_current_fiber(void);
+extern "C" void* __tsan_create_fiber(unsigned uFlags);
+extern "C" void __tsan_destroy_fiber(void* pvFiber);
+extern "C" void __tsan_switch_to_fiber(void* pvFiber, unsigned uFlags);
+#endif
+
+#if defined(__x86_64__)
+/*
+ysp_fiber_switch(&pvSaveSp, pvLoadSp): push the callee-saved registers, MXCSR and the x87 control
+word on the current stack, store the stack pointer, load the other one and pop the same frame.
+a new stack starts with such a frame whose return address is ysp_fiber_start, which calls r13(r12).
+*/
+extern "C" void ysp_fiber_switch(void** ppvSaveSp, void* pvLoadSp);
+extern "C" void ysp_fiber_start();
+asm(
+	".text\n"
+	".globl ysp_fiber_switch\n"
+	".type ysp_fiber_switch,@function\n"
+	".align 16\n"
+	"ysp_fiber_switch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq %rsi, %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size ysp_fiber_switch,.-ysp_fiber_switch\n"
+	".globl ysp_fiber_start\n"
+	".type ysp_fiber_start,@function\n"
+	"ysp_fiber_start:\n"
+	"	movq %r12, %rdi\n"
+	"	callq *%r13\n"
+	"	ud2\n"
+	".size ysp_fiber_start,.-ysp_fiber_start\n"
+);
+typedef void* FiberContext_T;
+#else
+#include <ucontext.h>
+typedef ucontext_t FiberContext_T;
+#endif
+
+enum
+{
+	FIBER_RUNNING,		//on a worker or queued
+	FIBER_PARKED,		//off its stack, waiting for __resume()
+	FIBER_WOKEN			//__resume() came before the fiber was off its stack
+};
+
+struct tagFiber
+{
+	FiberScheduler            *pinstOwner;
+	FiberScheduler::CallBack_T pfnProc;
+	VOID                      *pvArg;
+	char                      *pcStack;		//lowest address of the mapping, the guard page
+	size_t                     uStackSize;	//usable part, above the guard page
+	FiberContext_T             stContext;	//saved while suspended
+	std::atomic<int>           iPark;		//FIBER_RUNNING/PARKED/WOKEN, see __resume()
+	bool                       bDone;
+#if !defined(__x86_64__)
+	VOID                     (*pfnMain)(PFiber);	//makecontext() can't pass a pointer
+#endif
+#ifdef FIBER_ASAN
+	void                      *pvAsanFake;
+#endif
+#ifdef FIBER_TSAN
+	void                      *pvTsanFiber;
+#endif
+};
+
+/*one per running __runSlice(), on the worker's stack; a fiber suspends back into it*/
+typedef struct tagFiberSlice
+{
+	FiberContext_T stContext;
+	PFiber         pstFiber;
+	bool           bRequeue;
+#ifdef FIBER_ASAN
+	const void    *pvAsanBottom;
+	size_t         uAsanSize;
+#endif
+#ifdef FIBER_TSAN
+	void          *pvTsanFiber;
+#endif
+}FiberSlice, *PFiberSlice;
+
+static thread_local PFiberSlice t_pstSlice = nullptr;
+
+/*
+a fiber may come back on another thread: the thread_local is read through a call every time,
+so no address of the old thread's copy is kept across a switch
+*/
+static __attribute__((noinline)) PFiberSlice currentSlice()
+{
+	return t_pstSlice;
+}
+
+static __attribute__((noinline)) VOID setCurrentSlice(PFiberSlice pstSlice)
+{
+	t_pstSlice = pstSlice;
+}
+
+static VOID switchContext(FiberContext_T* pstSave, FiberContext_T* pstLoad)
+{
+#if defined(__x86_64__)
+	ysp_fiber_switch(pstSave, *pstLoad);
+#else
+	swapcontext(pstSave, pstLoad);
+#endif
+}
+
+#if !defined(__x86_64__)
+static VOID ucontextEntry()
+{
+	PFiber pstFiber = currentSlice()->pstFiber;
+	pstFiber->pfnMain(pstFiber);
+}
+#endif
+
+/**
+Function:	FiberScheduler()
+@brief      Constructor of FiberScheduler. Stacks are mapped on demand.
+@param[in]  pinstPool:pool the fibers run on, stConfig:stack size and cache
+@param[out] None
+@return     None
+*/
+FiberScheduler::FiberScheduler(ThreadPool* pinstPool, const FiberConfig& stConfig):
+	m_pinstPool(pinstPool),
+	m_stConfig(stConfig),
+	m_uPageSize((size_t)sysconf(_SC_PAGESIZE)),
+	m_uStacksMapped(0),
+	m_uLive(0),
+	m_ullSpawned(0),
+	m_ullFinished(0),
+	m_ullSwitches(0)
+{
+	if (m_stConfig.uStackSize < FIBER_STACK_MIN) {
+		m_stConfig.uStackSize = FIBER_STACK_MIN;
+	}
+	m_stConfig.uStackSize = (m_stConfig.uStackSize + m_uPageSize - 1) & ~(m_uPageSize - 1);
+	m_fnSlice = [this](VOID* pvFiber)->int { return __runSlice(pvFiber); };
+}
+
+/**
+Function:	~FiberScheduler()
+@brief      Destructor of FiberScheduler. Waits for the live fibers, then unmaps the cached stacks.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+FiberScheduler::~FiberScheduler()
+{
+	wait();
+	std::lock_guard<std::mutex> guard(m_mtxStacks);
+	for (char* pcStack : m_vecStacks) {
+		munmap(pcStack, m_stConfig.uStackSize + m_uPageSize);
+	}
+}
+
+char* FiberScheduler::__takeStack()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_mtxStacks);
+		if (!m_vecStacks.empty()) {
+			char* pcStack = m_vecStacks.back();
+			m_vecStacks.pop_back();
+			return pcStack;
+		}
+	}
+
+	size_t uTotal = m_stConfig.uStackSize + m_uPageSize;
+	VOID* pvMap = mmap(nullptr, uTotal, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+	if (pvMap == MAP_FAILED) {
+		return nullptr;
+	}
+	if (mprotect(pvMap, m_uPageSize, PROT_NONE) != 0) {		//the guard, stacks grow down
+		munmap(pvMap, uTotal);
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> guard(m_mtxStacks);
+	m_uStacksMapped++;
+	return (char*)pvMap;
+}
+
+VOID FiberScheduler::__giveStack(char* pcStack)
+{
+#ifdef FIBER_ASAN
+	__asan_unpoison_memory_region(pcStack + m_uPageSize, m_stConfig.uStackSize);	//redzones of the finished fiber's frames
+#endif
+	std::lock_guard<std::mutex> guard(m_mtxStacks);
+	if (m_vecStacks.size() < m_stConfig.uMaxCachedStacks) {
+		m_vecStacks.push_back(pcStack);
+		return;
+	}
+	munmap(pcStack, m_stConfig.uStackSize + m_uPageSize);
+	m_uStacksMapped--;
+}
+
+/**
+Function:	spawn()
+@brief      Create a fiber for pfnProc(pvArg) and queue its first slice on the pool.
+@param[in]  pfnProc:task body, may suspend; pvArg:its argument
+@param[out] None
+@return     false if no stack could be mapped, nothing is queued then
+*/
+bool FiberScheduler::spawn(CallBack_T pfnProc, VOID* pvArg)
+{
+	char* pcStack = __takeStack();
+	if (pcStack == nullptr) {
+		return false;
+	}
+
+	PFiber pstFiber = new Fiber();
+	pstFiber->pinstOwner = this;
+	pstFiber->pfnProc = pfnProc;
+	pstFiber->pvArg = pvArg;
+	pstFiber->pcStack = pcStack;
+	pstFiber->uStackSize = m_stConfig.uStackSize;
+	pstFiber->iPark.store(FIBER_RUNNING, std::memory_order_relaxed);
+	pstFiber->bDone = false;
+#ifdef FIBER_ASAN
+	pstFiber->pvAsanFake = nullptr;
+#endif
+#ifdef FIBER_TSAN
+	pstFiber->pvTsanFiber = __tsan_create_fiber(0);
+#endif
+
+#if defined(__x86_64__)
+	char* pcTop = pcStack + m_uPageSize + m_stConfig.uStackSize;
+	//the frame ysp_fiber_switch pops: MXCSR and x87 control word, r15, r14, r13, r12, rbx, rbp, return address;
+	//it ends 16 bytes below the aligned top so the call in ysp_fiber_start sees an aligned stack
+	VOID** ppvFrame = (VOID**)(((uintptr_t)pcTop & ~(uintptr_t)15) - 80);
+	uint64_t ullControl = 0x1F80ull | (0x037Full << 32);
+	ppvFrame[0] = (VOID*)(uintptr_t)ullControl;
+	ppvFrame[1] = nullptr;
+	ppvFrame[2] = nullptr;
+	ppvFrame[3] = (VOID*)&FiberScheduler::__fiberMain;
+	ppvFrame[4] = pstFiber;
+	ppvFrame[5] = nullptr;
+	ppvFrame[6] = nullptr;
+	ppvFrame[7] = (VOID*)&ysp_fiber_start;
+	pstFiber->stContext = ppvFrame;
+#else
+	getcontext(&pstFiber->stContext);
+	pstFiber->stContext.uc_stack.ss_sp = pcStack + m_uPageSize;
+	pstFiber->stContext.uc_stack.ss_size = m_stConfig.uStackSize;
+	pstFiber->stContext.uc_link = nullptr;
+	pstFiber->pfnMain = &FiberScheduler::__fiberMain;
+	makecontext(&pstFiber->stContext, ucontextEntry, 0);
+#endif
+
+	{
+		std::lock_guard<std::mutex> guard(m_mtxState);
+		m_uLive++;
+		m_ullSpawned++;
+	}
+	m_pinstPool->addTask(m_fnSlice, pstFiber, "fiber");
+	return true;
+}
+
+/**
+Function:	__runSlice()
+@brief      Pool task: switch onto the fiber and run it until it suspends or returns. A suspended
+            fiber is queued again from here, once its stack is no longer in use.
+@param[in]  pvFiber:the fiber
+@param[out] None
+@return     0
+*/
+int FiberScheduler::__runSlice(VOID* pvFiber)
+{
+	PFiber pstFiber = (PFiber)pvFiber;
+	FiberSlice stSlice;
+	stSlice.pstFiber = pstFiber;
+	stSlice.bRequeue = false;
+	PFiberSlice pstOuter = currentSlice();		//a fiber that helps out with queued tasks nests slices
+	setCurrentSlice(&stSlice);
+	m_ullSwitches.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef FIBER_TSAN
+	stSlice.pvTsanFiber = __tsan_get_current_fiber();
+	__tsan_switch_to_fiber(pstFiber->pvTsanFiber, 0);
+#endif
+#ifdef FIBER_ASAN
+	VOID* pvFake = nullptr;
+	__sanitizer_start_switch_fiber(&pvFake, pstFiber->pcStack + m_uPageSize, pstFiber->uStackSize);
+#endif
+	switchContext(&stSlice.stContext, &pstFiber->stContext);
+#ifdef FIBER_ASAN
+	__sanitizer_finish_switch_fiber(pvFake, nullptr, nullptr);
+#endif
+
+	setCurrentSlice(pstOuter);
+	if (pstFiber->bDone) {
+		__finish(pstFiber);
+		return 0;
+	}
+	if (stSlice.bRequeue || pstFiber->iPark.exchange(FIBER_PARKED) == FIBER_WOKEN) {
+		pstFiber->iPark.store(FIBER_RUNNING, std::memory_order_relaxed);
+		m_pinstPool->addTask(m_fnSlice, pstFiber, "fiber");
+	}
+	return 0;
+}
+
+VOID FiberScheduler::__finish(PFiber pstFiber)
+{
+#ifdef FIBER_TSAN
+	__tsan_destroy_fiber(pstFiber->pvTsanFiber);
+#endif
+	__giveStack(pstFiber->pcStack);
+	delete pstFiber;
+
+	std::lock_guard<std::mutex> guard(m_mtxState);
+	m_uLive--;
+	m_ullFinished++;
+	if (m_uLive == 0) {
+		m_condIdle.notify_all();
+	}
+}
+
+/**
+Function:	__fiberMain()
+@brief      First frame of every fiber stack: run the task, then switch back for good.
+@param[in]  pstFiber:the fiber
+@param[out] None
+@return     never returns
+*/
+VOID FiberScheduler::__fiberMain(PFiber pstFiber)
+{
+	PFiberSlice pstSlice = currentSlice();
+#ifdef FIBER_ASAN
+	__sanitizer_finish_switch_fiber(nullptr, &pstSlice->pvAsanBottom, &pstSlice->uAsanSize);
+#endif
+	pstFiber->pfnProc(pstFiber->pvArg);
+	pstFiber->bDone = true;
+
+	pstSlice = currentSlice();		//the fiber may have moved to another worker
+#ifdef FIBER_TSAN
+	__tsan_switch_to_fiber(pstSlice->pvTsanFiber, 0);
+#endif
+#ifdef FIBER_ASAN
+	__sanitizer_start_switch_fiber(nullptr, pstSlice->pvAsanBottom, pstSlice->uAsanSize);
+#endif
+	switchContext(&pstFiber->stContext, &pstSlice->stContext);
+	abort();
+}
+
+PFiber FiberScheduler::__current()
+{
+	PFiberSlice pstSlice = currentSlice();
+	return pstSlice == nullptr ? nullptr : pstSlice->pstFiber;
+}
+
+bool FiberScheduler::inFiber()
+{
+	return __current() != nullptr;
+}
+
+/**
+Function:	__suspend()
+@brief      Switch from the calling fiber back to the worker that runs it. The fiber may already be
+            known to a waker, __resume() before the switch is kept and acted on by the worker.
+@param[in]  bRequeue:queue the fiber again right away instead of waiting for __resume()
+@param[out] None
+@return     None, once the fiber was resumed
+*/
+VOID FiberScheduler::__suspend(bool bRequeue)
+{
+	PFiberSlice pstSlice = currentSlice();
+	PFiber pstFiber = pstSlice->pstFiber;
+	pstSlice->bRequeue = bRequeue;
+
+#ifdef FIBER_TSAN
+	__tsan_switch_to_fiber(pstSlice->pvTsanFiber, 0);
+#endif
+#ifdef FIBER_ASAN
+	__sanitizer_start_switch_fiber(&pstFiber->pvAsanFake, pstSlice->pvAsanBottom, pstSlice->uAsanSize);
+#endif
+	switchContext(&pstFiber->stContext, &pstSlice->stContext);
+#ifdef FIBER_ASAN
+	pstSlice = currentSlice();
+	__sanitizer_finish_switch_fiber(pstFiber->pvAsanFake, &pstSlice->pvAsanBottom, &pstSlice->uAsanSize);
+#endif
+}
+
+/**
+Function:	__resume()
+@brief      Queue a suspended fiber. Whoever of the waker and the worker comes second queues it:
+            the worker once the fiber is off its stack, the waker if that has already happened.
+@param[in]  pstFiber:fiber that suspended with bRequeue false
+@param[out] None
+@return     None
+*/
+VOID FiberScheduler::__resume(PFiber pstFiber)
+{
+	if (pstFiber->iPark.exchange(FIBER_WOKEN) != FIBER_PARKED) {
+		return;
+	}
+	pstFiber->iPark.store(FIBER_RUNNING, std::memory_order_relaxed);
+	FiberScheduler* pinstOwner = pstFiber->pinstOwner;
+	pinstOwner->m_pinstPool->addTask(pinstOwner->m_fnSlice, pstFiber, "fiber");
+}
+
+VOID FiberScheduler::yield()
+{
+	if (!inFiber()) {
+		std::this_thread::yield();
+		return;
+	}
+	__suspend(true);
+}
+
+/**
+Function:	wait()
+@brief      Block the calling thread until no fiber of this scheduler is live.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+VOID FiberScheduler::wait()
+{
+	std::unique_lock<std::mutex> uLocker(m_mtxState);
+	m_condIdle.wait(uLocker, [this] { return m_uLive == 0; });
+}
+
+FiberScheduler::FiberStats FiberScheduler::getStats()
+{
+	FiberStats stStats;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxState);
+		stStats.ullSpawned = m_ullSpawned;
+		stStats.ullFinished = m_ullFinished;
+		stStats.uLive = m_uLive;
+	}
+	stStats.ullSwitches = m_ullSwitches.load(std::memory_order_relaxed);
+	std::lock_guard<std::mutex> guard(m_mtxStacks);
+	stStats.uStacksMapped = m_uStacksMapped;
+	stStats.uStacksCached = m_vecStacks.size();
+	return stStats;
+}
+
+FiberMutex::FiberMutex():
+	m_bLocked(false)
+{
+}
+
+FiberMutex::~FiberMutex()
+{
+}
+
+/**
+Function:	lock()
+@brief      Take the mutex. A fiber that has to wait is suspended and resumed as the new owner.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+VOID FiberMutex::lock()
+{
+	std::unique_lock<std::mutex> uLocker(m_mtxState);
+	if (!m_bLocked) {
+		m_bLocked = true;
+		return;
+	}
+	FiberWaiter stWaiter = { FiberScheduler::__current(), false };
+	m_qWaiters.push_back(&stWaiter);
+	if (stWaiter.pstFiber != nullptr) {
+		uLocker.unlock();
+		FiberScheduler::__suspend(false);		//resumed by unlock() as the owner
+		return;
+	}
+	m_condThreads.wait(uLocker, [&stWaiter] { return stWaiter.bWoken; });
+}
+
+bool FiberMutex::try_lock()
+{
+	std::lock_guard<std::mutex> guard(m_mtxState);
+	if (m_bLocked) {
+		return false;
+	}
+	m_bLocked = true;
+	return true;
+}
+
+/**
+Function:	unlock()
+@brief      Release the mutex, or hand it to the oldest waiter which stays the owner when it resumes.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+VOID FiberMutex::unlock()
+{
+	PFiber pstWake = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxState);
+		if (m_qWaiters.empty()) {
+			m_bLocked = false;
+			return;
+		}
+		PFiberWaiter pstWaiter = m_qWaiters.front();
+		m_qWaiters.pop_front();
+		pstWake = pstWaiter->pstFiber;		//the waiter may be gone once bWoken is seen
+		pstWaiter->bWoken = true;
+		if (pstWake == nullptr) {
+			m_condThreads.notify_all();
+		}
+	}
+	if (pstWake != nullptr) {
+		FiberScheduler::__resume(pstWake);
+	}
+}
+
+FiberCondVar::FiberCondVar()
+{
+}
+
+FiberCondVar::~FiberCondVar()
+{
+}
+
+/**
+Function:	wait()
+@brief      Release the mutex and suspend until notified, then take the mutex again.
+@param[in]  uLocker:owns a FiberMutex
+@param[out] None
+@return     None
+*/
+VOID FiberCondVar::wait(std::unique_lock<FiberMutex>& uLocker)
+{
+	std::unique_lock<std::mutex> uState(m_mtxState);
+	FiberWaiter stWaiter = { FiberScheduler::__current(), false };
+	m_qWaiters.push_back(&stWaiter);
+	uLocker.mutex()->unlock();		//a notify needs m_mtxState, it can't slip in between
+	if (stWaiter.pstFiber != nullptr) {
+		uState.unlock();
+		FiberScheduler::__suspend(false);
+	}
+	else {
+		m_condThreads.wait(uState, [&stWaiter] { return stWaiter.bWoken; });
+		uState.unlock();
+	}
+	uLocker.mutex()->lock();
+}
+
+VOID FiberCondVar::__wake(PFiberWaiter pstWaiter, std::vector<PFiber>& vecFibers)
+{
+	if (pstWaiter->pstFiber != nullptr) {
+		vecFibers.push_back(pstWaiter->pstFiber);
+	}
+	else {
+		m_condThreads.notify_all();
+	}
+	pstWaiter->bWoken = true;
+}
+
+VOID FiberCondVar::notify_one()
+{
+	std::vector<PFiber> vecFibers;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxState);
+		if (!m_qWaiters.empty()) {
+			__wake(m_qWaiters.front(), vecFibers);
+			m_qWaiters.pop_front();
+		}
+	}
+	for (PFiber pstFiber : vecFibers) {
+		FiberScheduler::__resume(pstFiber);
+	}
+}
+
+VOID FiberCondVar::notify_all()
+{
+	std::vector<PFiber> vecFibers;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxState);
+		for (PFiberWaiter pstWaiter : m_qWaiters) {
+			__wake(pstWaiter, vecFibers);
+		}
+		m_qWaiters.clear();
+	}
+	for (PFiber pstFiber : vecFibers) {
+		FiberScheduler::__resume(pstFiber);
+	}
+}
+
+#endif //__linux__
@@ -0,0 +1,179 @@
+#ifndef FIBER_H_
+#define FIBER_H_
+
+#ifdef __linux__
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "thread_pool.h"
+
+#define FIBER_STACK_SIZE (64u << 10)		//Default usable stack of one fiber, a guard page comes on top.
+#define FIBER_STACK_MIN (16u << 10)
+#define FIBER_STACK_CACHE (64)				//Stacks kept mapped for reuse by default.
+
+typedef struct tagFiber Fiber, *PFiber;		//defined in fiber.cpp, the saved context is per architecture
+typedef struct tagFiberWaiter
+{
+	PFiber pstFiber;		//nullptr for a plain thread
+	bool   bWoken;
+}FiberWaiter, *PFiberWaiter;
+
+/**
+@class	FiberScheduler
+@brief	Stackful fibers on the thread pool, for blocking-style task code that must not hold a worker.
+						   1.spawn() runs the task on its own small stack; a pool task switches onto it
+						     and runs it until it returns or suspends, the worker is then free again
+						   2.yield(), FiberMutex and FiberCondVar suspend the fiber instead of the thread;
+						     a resumed fiber is queued on the pool like any task and may go on on another worker
+						   3.the switch saves the callee-saved registers and swaps stacks, no syscall
+						     (x86-64 assembly, ucontext elsewhere)
+						   4.stacks are mmap'd with a PROT_NONE guard page below, an overflow faults
+						     instead of writing into the neighbour; up to uMaxCachedStacks are kept for reuse
+						   5.no thread_local pointers and no scratch arena memory across a suspension,
+						     both belong to the worker the fiber ran on before
+@return	None
+-----------------HOW TO USE IT
+	FiberScheduler instFibers(ThreadPool::getInstance());
+	FiberMutex instMutex;
+	FiberCondVar instReady;
+
+	instFibers.spawn([&](VOID*)->int {
+		std::unique_lock<FiberMutex> uLocker(instMutex);
+		instReady.wait(uLocker, [&] { return bLoaded; });	//the worker runs other fibers meanwhile
+		...
+		return 0;
+	}, nullptr);
+	...
+	instFibers.wait();		//every spawned fiber has returned
+*/
+class FiberScheduler
+{
+public:
+	typedef ThreadPool::CallBack_T CallBack_T;
+	typedef struct tagFiberConfig
+	{
+		size_t uStackSize;			//rounded up to pages, at least FIBER_STACK_MIN
+		UINT   uMaxCachedStacks;	//finished fibers' stacks kept for the next spawn
+		tagFiberConfig():
+			uStackSize(FIBER_STACK_SIZE),
+			uMaxCachedStacks(FIBER_STACK_CACHE)
+		{
+		}
+	}FiberConfig, *PFiberConfig;
+	typedef struct tagFiberStats
+	{
+		unsigned long long ullSpawned;
+		unsigned long long ullFinished;
+		unsigned long long ullSwitches;		//times a worker switched onto a fiber
+		size_t             uLive;			//spawned and not finished
+		size_t             uStacksMapped;	//in use plus cached
+		size_t             uStacksCached;
+	}FiberStats, *PFiberStats;
+
+	explicit FiberScheduler(ThreadPool* pinstPool = ThreadPool::getInstance(), const FiberConfig& stConfig = FiberConfig());
+	~FiberScheduler();		//waits for the live fibers
+
+	FiberScheduler(const FiberScheduler&) = delete;
+	FiberScheduler& operator= (const FiberScheduler&) = delete;
+
+	bool spawn(CallBack_T pfnProc, VOID* pvArg);	//spawn--false if no stack could be mapped
+	VOID wait();									//wait--until every fiber spawned so far has returned; not from a fiber
+	FiberStats getStats();
+
+	static bool inFiber();		//inFiber--the caller runs on a fiber stack
+	static VOID yield();		//yield--queue the calling fiber behind the tasks waiting now, a thread just yields
+
+	friend class FiberMutex;
+	friend class FiberCondVar;
+
+private:
+	int  __runSlice(VOID* pvFiber);		//__runSlice--pool task, runs the fiber until it suspends or returns
+	char* __takeStack();
+	VOID __giveStack(char* pcStack);
+	VOID __finish(PFiber pstFiber);
+	static VOID __fiberMain(PFiber pstFiber);
+	static PFiber __current();
+	static VOID __suspend(bool bRequeue);		//__suspend--back to the worker, bRequeue or __resume() queues the fiber again
+	static VOID __resume(PFiber pstFiber);		//__resume--from any thread, also before the fiber is off its stack
+
+	ThreadPool              *m_pinstPool;
+	FiberConfig              m_stConfig;
+	size_t                   m_uPageSize;
+	CallBack_T               m_fnSlice;
+	std::mutex               m_mtxStacks;
+	std::vector<char*>       m_vecStacks;		//cached, lowest address of the mapping
+	size_t                   m_uStacksMapped;	//guarded by m_mtxStacks
+	std::mutex               m_mtxState;
+	std::condition_variable  m_condIdle;
+	size_t                   m_uLive;			//guarded by m_mtxState
+	unsigned long long       m_ullSpawned;		//guarded by m_mtxState
+	unsigned long long       m_ullFinished;		//guarded by m_mtxState
+	std::atomic<unsigned long long> m_ullSwitches;
+};
+
+/**
+@class	FiberMutex
+@brief	Mutex that suspends a waiting fiber instead of blocking its worker.
+						   1.unlock() hands the mutex straight to the oldest waiter, FIFO and no barging
+						   2.plain threads may lock it too, they block on a condition variable
+						   3.lock/unlock fit std::unique_lock and std::lock_guard
+@return	None
+*/
+class FiberMutex
+{
+public:
+	FiberMutex();
+	~FiberMutex();
+
+	FiberMutex(const FiberMutex&) = delete;
+	FiberMutex& operator= (const FiberMutex&) = delete;
+
+	VOID lock();
+	bool try_lock();
+	VOID unlock();
+
+private:
+	std::mutex                 m_mtxState;
+	std::condition_variable    m_condThreads;	//thread waiters, each checks its own bWoken
+	bool                       m_bLocked;
+	std::deque<PFiberWaiter>   m_qWaiters;
+};
+
+/**
+@class	FiberCondVar
+@brief	Condition variable for FiberMutex; a waiting fiber is suspended, a waiting thread blocks.
+@return	None
+*/
+class FiberCondVar
+{
+public:
+	FiberCondVar();
+	~FiberCondVar();
+
+	FiberCondVar(const FiberCondVar&) = delete;
+	FiberCondVar& operator= (const FiberCondVar&) = delete;
+
+	VOID wait(std::unique_lock<FiberMutex>& uLocker);
+	template <typename PRED_T>
+	VOID wait(std::unique_lock<FiberMutex>& uLocker, PRED_T fnPred)
+	{
+		while (!fnPred()) {
+			wait(uLocker);
+		}
+	}
+	VOID notify_one();
+	VOID notify_all();
+
+private:
+	VOID __wake(PFiberWaiter pstWaiter, std::vector<PFiber>& vecFibers);
+
+	std::mutex                 m_mtxState;
+	std::condition_variable    m_condThreads;
+	std::deque<PFiberWaiter>   m_qWaiters;
+};
+
+#endif //__linux__
+#endif //FIBER_H_
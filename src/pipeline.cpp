@@ -0,0 +1,236 @@
+#include "pipeline.h"
+
+/**
+Function:	Pipeline()
+@brief      Constructor of Pipeline.
+@param[in]  pinstPool:pool the stages run on
+@param[out] None
+@return     None
+*/
+Pipeline::Pipeline(ThreadPool* pinstPool):
+	m_pinstPool(pinstPool),
+	m_uMaxTokens(0),
+	m_uInFlight(0),
+	m_ullNextSeq(0),
+	m_ullPosted(0),
+	m_bInputDone(false),
+	m_bRunning(false),
+	m_stStats()
+{
+	m_fnStep = [this](VOID* pvToken)->int { return __step(pvToken); };
+}
+
+Pipeline::~Pipeline()
+{
+}
+
+Pipeline& Pipeline::addStage(StageMode_E eMode, Stage_T fnStage)
+{
+	Stage stStage;
+	stStage.eMode = m_vecStages.empty() ? STAGE_SERIAL_IN_ORDER : eMode;	//the source is serial whatever it asks for
+	stStage.fnStage = fnStage;
+	stStage.bBusy = false;
+	stStage.ullNextSeq = 0;
+	m_vecStages.push_back(std::move(stStage));
+	return *this;
+}
+
+Pipeline::PipelineStats Pipeline::getStats()
+{
+	std::lock_guard<std::mutex> guard(m_mtxPipe);
+	return m_stStats;
+}
+
+/**
+Function:	run()
+@brief      Feed items from the source through every stage until the source returns nullptr and
+            the last item has left. The calling thread runs queued pool tasks while it waits, so a
+            pipeline may be run from a worker without taking that worker away from the stages.
+@param[in]  uMaxTokens:most items alive at once
+@param[out] None
+@return     false if there is no stage, uMaxTokens is 0 or the pipeline is already running
+*/
+bool Pipeline::run(UINT uMaxTokens)
+{
+	std::unique_lock<std::mutex> uLocker(m_mtxPipe);
+	if (m_bRunning || m_vecStages.empty() || uMaxTokens == 0) {
+		return false;
+	}
+	m_bRunning = true;
+	m_uMaxTokens = uMaxTokens;
+	m_uInFlight = 0;
+	m_ullNextSeq = 0;
+	m_bInputDone = false;
+	m_stStats = PipelineStats();
+	m_vecTokens.assign(uMaxTokens, Token());
+	m_vecFreeTokens.clear();
+	for (auto& stToken : m_vecTokens) {
+		m_vecFreeTokens.push_back(&stToken);
+	}
+	for (auto& stStage : m_vecStages) {
+		stStage.bBusy = false;
+		stStage.ullNextSeq = 0;
+	}
+
+	PToken apPost[1];
+	__post(apPost, __pumpSource(apPost));
+	while (!m_bInputDone || m_uInFlight != 0) {
+		unsigned long long ullPosted = m_ullPosted;
+		uLocker.unlock();
+		bool bRan = m_pinstPool->runPendingTask();
+		uLocker.lock();
+		//nothing to help with and no step queued meanwhile: sleep until a step queues one or the end
+		if (!bRan && ullPosted == m_ullPosted && (!m_bInputDone || m_uInFlight != 0)) {
+			m_condPipe.wait(uLocker);
+		}
+	}
+	m_bRunning = false;
+	return true;
+}
+
+/**
+Function:	__step()
+@brief      Pool task: run the stage the item is at, then hand the item to the next stage and the
+            stage to its next waiting item. Bookkeeping and posting happen under m_mtxPipe, so once
+            run() sees the end no step touches the pipeline any more.
+@param[in]  pvToken:the item's token
+@param[out] None
+@return     0
+*/
+int Pipeline::__step(VOID* pvToken)
+{
+	PToken pToken = (PToken)pvToken;
+	Stage& stStage = m_vecStages[pToken->uStage];
+	PToken apPost[3];
+	UINT uPost = 0;
+
+	if (pToken->uStage == 0) {
+		VOID* pvItem = stStage.fnStage(nullptr);
+
+		std::lock_guard<std::mutex> guard(m_mtxPipe);
+		stStage.bBusy = false;
+		if (pvItem == nullptr) {
+			m_bInputDone = true;
+			m_uInFlight--;
+			m_vecFreeTokens.push_back(pToken);
+		}
+		else {
+			pToken->pvItem = pvItem;
+			pToken->ullSeq = m_ullNextSeq++;
+			m_stStats.ullItems++;
+			if (++pToken->uStage == m_vecStages.size()) {
+				m_uInFlight--;
+				m_vecFreeTokens.push_back(pToken);
+			}
+			else {
+				uPost += __enterStage(pToken, apPost + uPost);
+			}
+			uPost += __pumpSource(apPost + uPost);
+		}
+		__post(apPost, uPost);
+		m_condPipe.notify_one();
+		return 0;
+	}
+
+	//a dropped item still passes the later stages, in-order ones count it
+	if (pToken->pvItem != nullptr) {
+		pToken->pvItem = stStage.fnStage(pToken->pvItem);
+		if (pToken->pvItem == nullptr && pToken->uStage + 1 < m_vecStages.size()) {
+			std::lock_guard<std::mutex> guard(m_mtxPipe);
+			m_stStats.ullDropped++;
+		}
+	}
+
+	std::lock_guard<std::mutex> guard(m_mtxPipe);
+	if (stStage.eMode != STAGE_PARALLEL) {
+		stStage.bBusy = false;
+		stStage.ullNextSeq++;
+		PToken pNext = __nextWaiting(stStage);
+		if (pNext != nullptr) {
+			stStage.bBusy = true;
+			apPost[uPost++] = pNext;
+		}
+	}
+	if (++pToken->uStage == m_vecStages.size()) {
+		m_uInFlight--;
+		m_vecFreeTokens.push_back(pToken);
+		uPost += __pumpSource(apPost + uPost);
+	}
+	else {
+		uPost += __enterStage(pToken, apPost + uPost);
+	}
+	__post(apPost, uPost);
+	m_condPipe.notify_one();
+	return 0;
+}
+
+/**
+Function:	__enterStage()
+@brief      Route an item into pToken->uStage: parallel stages take it at once, a serial stage takes
+            it if idle (and, in order, if it is the item it waits for), otherwise it waits there.
+            Called with m_mtxPipe held.
+@param[in]  pToken:the item
+@param[out] apPost:filled with the token when it can run now
+@return     tokens written to apPost
+*/
+UINT Pipeline::__enterStage(PToken pToken, PToken* apPost)
+{
+	Stage& stStage = m_vecStages[pToken->uStage];
+	if (stStage.eMode == STAGE_PARALLEL) {
+		apPost[0] = pToken;
+		return 1;
+	}
+	if (!stStage.bBusy && (stStage.eMode == STAGE_SERIAL_OUT_OF_ORDER || pToken->ullSeq == stStage.ullNextSeq)) {
+		stStage.bBusy = true;
+		apPost[0] = pToken;
+		return 1;
+	}
+	if (stStage.eMode == STAGE_SERIAL_IN_ORDER) {
+		stStage.mapWaiting[pToken->ullSeq] = pToken;
+	}
+	else {
+		stStage.qWaiting.push_back(pToken);
+	}
+	return 0;
+}
+
+UINT Pipeline::__pumpSource(PToken* apPost)
+{
+	if (m_bInputDone || m_vecStages[0].bBusy || m_vecFreeTokens.empty()) {
+		return 0;
+	}
+	PToken pToken = m_vecFreeTokens.back();
+	m_vecFreeTokens.pop_back();
+	pToken->pvItem = nullptr;
+	pToken->uStage = 0;
+	m_vecStages[0].bBusy = true;
+	m_uInFlight++;
+	m_stStats.uPeakInFlight = (std::max)(m_stStats.uPeakInFlight, m_uInFlight);
+	apPost[0] = pToken;
+	return 1;
+}
+
+Pipeline::PToken Pipeline::__nextWaiting(Stage& stStage)
+{
+	PToken pToken = nullptr;
+	if (stStage.eMode == STAGE_SERIAL_IN_ORDER) {
+		auto itFirst = stStage.mapWaiting.begin();
+		if (itFirst != stStage.mapWaiting.end() && itFirst->first == stStage.ullNextSeq) {
+			pToken = itFirst->second;
+			stStage.mapWaiting.erase(itFirst);
+		}
+	}
+	else if (!stStage.qWaiting.empty()) {
+		pToken = stStage.qWaiting.front();
+		stStage.qWaiting.pop_front();
+	}
+	return pToken;
+}
+
+VOID Pipeline::__post(PToken* apPost, UINT uCount)
+{
+	for (UINT i = 0; i < uCount; ++i) {
+		m_pinstPool->addTask(m_fnStep, apPost[i], "stage");
+	}
+	m_ullPosted += uCount;
+}
@@ -0,0 +1,98 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "thread_pool.h"
+
+/**
+@class	Pipeline
+@brief	Chain of stages run on the thread pool with a fixed number of items in flight.
+						   1.the first stage is the source, called serially with nullptr until it returns nullptr
+						   2.every other stage gets the item pointer of the stage before and returns the item
+						     for the next one; returning nullptr drops the item, ownership moves with the pointer
+						   3.STAGE_SERIAL_IN_ORDER sees items in source order, STAGE_SERIAL_OUT_OF_ORDER one at
+						     a time in any order, STAGE_PARALLEL on as many workers as there are items
+						   4.run(uMaxTokens) lets at most uMaxTokens items exist at once: the source waits for a
+						     token, items waiting for a busy serial stage hold theirs, so memory stays bounded
+						     and throughput settles at the rate of the slowest stage
+@return	None
+-----------------HOW TO USE IT
+	Pipeline instPipe;		//default to ThreadPool::getInstance()
+	instPipe.addStage(Pipeline::STAGE_SERIAL_IN_ORDER, [&](VOID*)->VOID* { return readRecord(pFile); })
+	        .addStage(Pipeline::STAGE_PARALLEL, [](VOID* pvRec)->VOID* { return transform((PRecord)pvRec); })
+	        .addStage(Pipeline::STAGE_SERIAL_IN_ORDER, [&](VOID* pvRec)->VOID* { writeRecord((PRecord)pvRec); return nullptr; });
+	instPipe.run(16);		//returns when the source is exhausted and every item has left
+*/
+class Pipeline
+{
+public:
+	typedef std::function<VOID*(VOID*)> Stage_T;
+	typedef enum tagStageMode
+	{
+		STAGE_SERIAL_IN_ORDER,
+		STAGE_SERIAL_OUT_OF_ORDER,
+		STAGE_PARALLEL
+	}StageMode_E;
+	typedef struct tagPipelineStats
+	{
+		unsigned long long ullItems;		//items the source produced
+		unsigned long long ullDropped;		//items a stage after the source returned nullptr for
+		UINT               uPeakInFlight;	//most tokens taken at once, never above uMaxTokens
+	}PipelineStats, *PPipelineStats;
+
+	explicit Pipeline(ThreadPool* pinstPool = ThreadPool::getInstance());
+	~Pipeline();
+
+	Pipeline(const Pipeline&) = delete;
+	Pipeline& operator= (const Pipeline&) = delete;
+
+	Pipeline& addStage(StageMode_E eMode, Stage_T fnStage);	//addStage--append a stage, the first one is the source
+	bool run(UINT uMaxTokens);		//run--process until the source is exhausted, helps the pool while waiting
+	PipelineStats getStats();		//getStats--of the last run
+
+private:
+	typedef struct tagToken
+	{
+		VOID              *pvItem;
+		unsigned long long ullSeq;		//source order
+		UINT               uStage;		//stage to run next
+	}Token, *PToken;
+
+	typedef struct tagStage
+	{
+		StageMode_E                     eMode;
+		Stage_T                         fnStage;
+		bool                            bBusy;			//serial stages: an item is in it
+		unsigned long long              ullNextSeq;		//in-order stages: the item it waits for
+		std::map<unsigned long long, PToken> mapWaiting;	//in-order stages: arrived early
+		std::deque<PToken>              qWaiting;		//out-of-order stages: arrived while busy
+	}Stage, *PStage;
+
+	int  __step(VOID* pvToken);						//__step--run one stage of one item, the pool task
+	UINT __enterStage(PToken pToken, PToken* apPost);	//__enterStage--route an item into its next stage
+	UINT __pumpSource(PToken* apPost);				//__pumpSource--start the source if a token is free
+	PToken __nextWaiting(Stage& stStage);
+	VOID __post(PToken* apPost, UINT uCount);		//__post--queue the steps, with m_mtxPipe held
+
+	ThreadPool                 *m_pinstPool;
+	ThreadPool::CallBack_T      m_fnStep;			//bound once, every pool task reuses it
+	std::vector<Stage>          m_vecStages;
+	std::vector<Token>          m_vecTokens;
+	std::vector<PToken>         m_vecFreeTokens;
+	std::mutex                  m_mtxPipe;			//guards everything below and the stage bookkeeping
+	std::condition_variable     m_condPipe;			//run() waits for new tasks or the end
+	UINT                        m_uMaxTokens;
+	UINT                        m_uInFlight;
+	unsigned long long          m_ullNextSeq;
+	unsigned long long          m_ullPosted;		//steps queued so far, run() sleeps only when it didn't move
+	bool                        m_bInputDone;
+	bool                        m_bRunning;
+	PipelineStats               m_stStats;
+};
+
+#endif //PIPELINE_H_
@@ -0,0 +1,291 @@
+#include "reactor.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <vector>
+
+#include "thread_pool.h"
+
+/**
+Function:	Reactor()
+@brief      Constructor of Reactor. Nothing is opened until start().
+@param[in]  pinstPool:pool the ready callbacks are queued on, eMode:who drives poll()
+@param[out] None
+@return     None
+*/
+Reactor::Reactor(ThreadPool* pinstPool, DriveMode_E eMode):
+	m_pinstPool(pinstPool),
+	m_eMode(eMode),
+	m_iEpollFd(-1),
+	m_iWakeFd(-1),
+	m_bStop(false)
+{
+}
+
+Reactor::~Reactor()
+{
+	stop();
+	std::lock_guard<std::mutex> guard(m_mtxWatch);
+	for (auto& pairWatch : m_mapWatch) {
+		if (pairWatch.second.bTimer) {
+			close(pairWatch.first);
+		}
+	}
+	m_mapWatch.clear();
+	if (m_iWakeFd >= 0) {
+		close(m_iWakeFd);
+	}
+	if (m_iEpollFd >= 0) {
+		close(m_iEpollFd);
+	}
+}
+
+/**
+Function:	start()
+@brief      Create the epoll set and its eventfd, then the loop thread in REACTOR_THREAD mode
+@param[in]  None
+@param[out] None
+@return     false if epoll or eventfd can't be created
+*/
+bool Reactor::start()
+{
+	m_iEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	m_iWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_iEpollFd < 0 || m_iWakeFd < 0) {
+		return false;
+	}
+
+	struct epoll_event stEvent = {};
+	stEvent.events = EPOLLIN;
+	stEvent.data.fd = m_iWakeFd;
+	if (epoll_ctl(m_iEpollFd, EPOLL_CTL_ADD, m_iWakeFd, &stEvent) != 0) {
+		return false;
+	}
+
+	if (m_eMode == REACTOR_THREAD) {
+		m_thrLoop = std::thread([this] {
+			TaskTracer::setThreadName("reactor");
+			while (!m_bStop.load()) {
+				poll(-1);
+			}
+		});
+	}
+	return true;
+}
+
+void Reactor::stop()
+{
+	m_bStop.store(true);
+	wake();
+	if (m_thrLoop.joinable()) {
+		m_thrLoop.join();
+	}
+}
+
+void Reactor::wake()
+{
+	if (m_iWakeFd >= 0) {
+		uint64_t ullOne = 1;
+		ssize_t iRet = write(m_iWakeFd, &ullOne, sizeof(ullOne));
+		(void)iRet;		//EAGAIN means a wakeup is already pending
+	}
+}
+
+bool Reactor::waitReadable(int iFd, CallBack_T pfnProc, void* pvArg)
+{
+	return __wait(iFd, false, pfnProc, pvArg);
+}
+
+bool Reactor::waitWritable(int iFd, CallBack_T pfnProc, void* pvArg)
+{
+	return __wait(iFd, true, pfnProc, pvArg);
+}
+
+/**
+Function:	waitTimeout()
+@brief      Queue pfnProc once uMs milliseconds have passed. The timer is a timerfd polled
+            like any other fd, so it needs no timer thread and no ordered timer list.
+@param[in]  uMs:delay, pfnProc/pvArg:the task
+@param[out] None
+@return     timer id for cancel(), -1 on failure
+*/
+int Reactor::waitTimeout(unsigned int uMs, CallBack_T pfnProc, void* pvArg)
+{
+	int iTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (iTimerFd < 0) {
+		return -1;
+	}
+	struct itimerspec stSpec = {};
+	stSpec.it_value.tv_sec = uMs / 1000;
+	stSpec.it_value.tv_nsec = (long)(uMs % 1000) * 1000000L;
+	if (uMs == 0) {
+		stSpec.it_value.tv_nsec = 1;	//all zero would disarm the timer
+	}
+	if (timerfd_settime(iTimerFd, 0, &stSpec, nullptr) != 0) {
+		close(iTimerFd);
+		return -1;
+	}
+
+	std::lock_guard<std::mutex> guard(m_mtxWatch);
+	FdWatch& stWatch = m_mapWatch[iTimerFd];
+	stWatch.bTimer = true;
+	stWatch.stRead.pfnProc = pfnProc;
+	stWatch.stRead.pvArg = pvArg;
+	if (!__arm(iTimerFd, stWatch)) {
+		m_mapWatch.erase(iTimerFd);
+		close(iTimerFd);
+		return -1;
+	}
+	return iTimerFd;
+}
+
+/**
+Function:	cancel()
+@brief      Drop the pending waiters of a fd or timer. Call it before closing a watched fd,
+            a recycled fd number would otherwise inherit the old waiters.
+@param[in]  iFd:fd or timer id
+@param[out] None
+@return     number of waiters dropped, 0 if they already ran
+*/
+unsigned int Reactor::cancel(int iFd)
+{
+	std::lock_guard<std::mutex> guard(m_mtxWatch);
+	auto itWatch = m_mapWatch.find(iFd);
+	if (itWatch == m_mapWatch.end()) {
+		return 0;
+	}
+	unsigned int uDropped = (itWatch->second.stRead.pfnProc ? 1 : 0) + (itWatch->second.stWrite.pfnProc ? 1 : 0);
+	if (itWatch->second.bInEpoll) {
+		epoll_ctl(m_iEpollFd, EPOLL_CTL_DEL, iFd, nullptr);
+	}
+	if (itWatch->second.bTimer) {
+		close(iFd);
+	}
+	m_mapWatch.erase(itWatch);
+	return uDropped;
+}
+
+/**
+Function:	poll()
+@brief      Wait once for readiness and queue the callbacks of every ready waiter on the pool.
+            Only one thread may poll at a time: the loop thread, or the worker driving the reactor.
+@param[in]  iTimeoutMs:epoll_wait timeout, -1 blocks until something is ready or wake() is called
+@param[out] None
+@return     number of callbacks queued
+*/
+unsigned int Reactor::poll(int iTimeoutMs)
+{
+	struct epoll_event aEvents[REACTOR_MAX_EVENTS];
+	int iReady = epoll_wait(m_iEpollFd, aEvents, REACTOR_MAX_EVENTS, iTimeoutMs);
+	if (iReady <= 0) {
+		return 0;
+	}
+
+	std::vector<Waiter> vecReady;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxWatch);
+		for (int i = 0; i < iReady; ++i) {
+			int iFd = aEvents[i].data.fd;
+			uint32_t uEvents = aEvents[i].events;
+			if (iFd == m_iWakeFd) {
+				uint64_t ullCount;
+				ssize_t iRet = read(m_iWakeFd, &ullCount, sizeof(ullCount));
+				(void)iRet;
+				continue;
+			}
+
+			auto itWatch = m_mapWatch.find(iFd);
+			if (itWatch == m_mapWatch.end()) {
+				continue;	//cancelled after epoll_wait returned
+			}
+			FdWatch& stWatch = itWatch->second;
+			if (stWatch.bTimer) {
+				vecReady.push_back(stWatch.stRead);
+				epoll_ctl(m_iEpollFd, EPOLL_CTL_DEL, iFd, nullptr);
+				close(iFd);
+				m_mapWatch.erase(itWatch);
+				continue;
+			}
+
+			//errors and hangups wake both sides, the callback sees them on its next read/write
+			if ((uEvents & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)) && stWatch.stRead.pfnProc) {
+				vecReady.push_back(stWatch.stRead);
+				stWatch.stRead = Waiter();
+			}
+			if ((uEvents & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && stWatch.stWrite.pfnProc) {
+				vecReady.push_back(stWatch.stWrite);
+				stWatch.stWrite = Waiter();
+			}
+			//one-shot disarmed the fd, the waiter still pending needs it back
+			if (stWatch.stRead.pfnProc || stWatch.stWrite.pfnProc) {
+				__arm(iFd, stWatch);
+			}
+		}
+	}
+
+	for (auto& stWaiter : vecReady) {
+		m_pinstPool->addTask(stWaiter.pfnProc, stWaiter.pvArg, "io");
+	}
+	return (unsigned int)vecReady.size();
+}
+
+bool Reactor::__wait(int iFd, bool bWrite, CallBack_T pfnProc, void* pvArg)
+{
+	if (iFd < 0 || !pfnProc) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(m_mtxWatch);
+	auto itWatch = m_mapWatch.find(iFd);
+	if (itWatch == m_mapWatch.end()) {
+		itWatch = m_mapWatch.emplace(iFd, FdWatch()).first;
+	}
+	FdWatch& stWatch = itWatch->second;
+	Waiter& stWaiter = bWrite ? stWatch.stWrite : stWatch.stRead;
+	if (stWatch.bTimer || stWaiter.pfnProc) {
+		return false;
+	}
+
+	stWaiter.pfnProc = pfnProc;
+	stWaiter.pvArg = pvArg;
+	if (!__arm(iFd, stWatch)) {
+		stWaiter = Waiter();
+		return false;
+	}
+	return true;
+}
+
+/**
+Function:	__arm()
+@brief      Register the pending interest of a fd as one-shot. Called with m_mtxWatch held.
+            A fd closed without cancel() left the epoll set on its own, MOD then fails and it is added again.
+@param[in]  iFd:the fd, stWatch:its waiters
+@param[out] None
+@return     false if epoll refuses the fd
+*/
+bool Reactor::__arm(int iFd, FdWatch& stWatch)
+{
+	struct epoll_event stEvent = {};
+	stEvent.events = EPOLLONESHOT;
+	if (stWatch.stRead.pfnProc) {
+		stEvent.events |= EPOLLIN | EPOLLRDHUP;
+	}
+	if (stWatch.stWrite.pfnProc) {
+		stEvent.events |= EPOLLOUT;
+	}
+	stEvent.data.fd = iFd;
+
+	if (stWatch.bInEpoll && epoll_ctl(m_iEpollFd, EPOLL_CTL_MOD, iFd, &stEvent) == 0) {
+		return true;
+	}
+	if (epoll_ctl(m_iEpollFd, EPOLL_CTL_ADD, iFd, &stEvent) != 0) {
+		return false;
+	}
+	stWatch.bInEpoll = true;
+	return true;
+}
+#endif  //__linux__
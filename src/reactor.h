@@ -0,0 +1,90 @@
+#ifndef REACTOR_H_
+#define REACTOR_H_
+
+#ifdef __linux__
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#define REACTOR_MAX_EVENTS (64)	//Events taken from epoll per wakeup.
+
+class ThreadPool;
+
+/**
+@class	Reactor
+@brief	epoll readiness waits that end in a pool task instead of a blocked worker.
+						   1.every wait is one-shot: the callback is queued once, wait again to get more
+						   2.a fd holds at most one read and one write waiter, both may be pending
+						   3.timers are timerfds in the same epoll set, closed once they fire
+						   4.driven either by its own thread, or by one idle worker which polls
+						     instead of sleeping and is woken through an eventfd by addTask
+@return	None
+-----------------HOW TO USE IT
+	ThreadPool::getInstance()->startReactor();			//or startReactor(Reactor::REACTOR_IDLE_WORKER)
+
+	ThreadPool::getInstance()->addTaskOnReadable(iSock, fnOnData, pvConn);	//fnOnData runs on a worker
+	int iTimer = ThreadPool::getInstance()->addTaskAfter(500, fnOnTimeout, pvConn);
+	...
+	ThreadPool::getInstance()->cancelWait(iSock);		//before close(iSock)
+*/
+class Reactor
+{
+public:
+	typedef std::function<int(void*)> CallBack_T;
+	typedef enum tagDriveMode
+	{
+		REACTOR_THREAD,			//a dedicated thread blocks in epoll_wait
+		REACTOR_IDLE_WORKER		//a worker with nothing to run blocks in epoll_wait
+	}DriveMode_E;
+
+	Reactor(ThreadPool* pinstPool, DriveMode_E eMode);
+	~Reactor();
+
+	Reactor(const Reactor&) = delete;
+	Reactor& operator= (const Reactor&) = delete;
+
+	bool start();				//start--create the epoll set, and the thread in REACTOR_THREAD mode
+	void stop();				//stop--join the thread, pending waits are dropped without running
+	DriveMode_E getMode() const { return m_eMode; }
+
+	bool waitReadable(int iFd, CallBack_T pfnProc, void* pvArg);	//waitReadable--false if fd already has a read waiter
+	bool waitWritable(int iFd, CallBack_T pfnProc, void* pvArg);
+	int  waitTimeout(unsigned int uMs, CallBack_T pfnProc, void* pvArg);	//waitTimeout--returns the timer id, -1 on failure
+	unsigned int cancel(int iFd);	//cancel--drop the waiters of a fd or timer id, returns how many
+
+	unsigned int poll(int iTimeoutMs);	//poll--one epoll_wait, ready callbacks are queued on the pool; one caller at a time
+	void wake();						//wake--make a blocked poll() return
+
+private:
+	typedef struct tagWaiter
+	{
+		CallBack_T pfnProc;
+		void      *pvArg;
+	}Waiter, *PWaiter;
+
+	typedef struct tagFdWatch
+	{
+		Waiter stRead;
+		Waiter stWrite;
+		bool   bTimer;
+		bool   bInEpoll;	//known to the epoll set, armed or not
+	}FdWatch, *PFdWatch;
+
+	bool __wait(int iFd, bool bWrite, CallBack_T pfnProc, void* pvArg);
+	bool __arm(int iFd, FdWatch& stWatch);	//__arm--(re)arm the one-shot interest of the pending waiters
+
+	ThreadPool                          *m_pinstPool;
+	DriveMode_E                          m_eMode;
+	int                                  m_iEpollFd;
+	int                                  m_iWakeFd;		//eventfd
+	std::atomic<bool>                    m_bStop;
+	std::thread                          m_thrLoop;
+	std::mutex                           m_mtxWatch;
+	std::unordered_map<int, FdWatch>     m_mapWatch;	//guarded by m_mtxWatch
+};
+#endif  //__linux__
+
+#endif //REACTOR_H_
@@ -0,0 +1,120 @@
+#include "scratch_arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+#include <algorithm>
+
+/**
+Function:	ScratchArena()
+@brief      Constructor of ScratchArena. The first chunk is reserved right away,
+            so a worker's first task doesn't pay for it.
+@param[in]  uChunkSize:size of the first chunk
+@param[out] None
+@return     None
+*/
+ScratchArena::ScratchArena(size_t uChunkSize):
+	m_pHead(nullptr),
+	m_pcCursor(nullptr),
+	m_pcLimit(nullptr),
+	m_uChunkSize(uChunkSize),
+	m_uUsed(0),
+	m_uHighWater(0),
+	m_uCapacity(0),
+	m_ullChunkAllocs(0),
+	m_ullResets(0)
+{
+	__newChunk(m_uChunkSize);
+}
+
+ScratchArena::~ScratchArena()
+{
+	__freeChunks(m_pHead);
+}
+
+/**
+Function:	reset()
+@brief      Release every allocation since the last reset. A single chunk is rewound in place;
+            overflow chunks are merged into one chunk big enough for the high-water mark.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+void ScratchArena::reset()
+{
+	m_ullResets.fetch_add(1, std::memory_order_relaxed);
+	if (m_uUsed > m_uHighWater.load(std::memory_order_relaxed)) {
+		m_uHighWater.store(m_uUsed, std::memory_order_relaxed);
+	}
+
+	if (m_pHead->pNext != nullptr) {
+		__freeChunks(m_pHead);
+		m_pHead = nullptr;
+		m_uChunkSize = std::max(m_uChunkSize, m_uHighWater.load(std::memory_order_relaxed));
+		__newChunk(m_uChunkSize);
+	}
+	m_pcCursor = (char*)(m_pHead + 1);
+	m_uUsed = 0;
+}
+
+ScratchArena::ScratchStats ScratchArena::getStats() const
+{
+	ScratchStats stStats;
+	stStats.uHighWater = m_uHighWater.load(std::memory_order_relaxed);
+	stStats.uCapacity = m_uCapacity.load(std::memory_order_relaxed);
+	stStats.ullChunkAllocs = m_ullChunkAllocs.load(std::memory_order_relaxed);
+	stStats.ullResets = m_ullResets.load(std::memory_order_relaxed);
+	return stStats;
+}
+
+void* ScratchArena::do_allocate(size_t uBytes, size_t uAlign)
+{
+	uintptr_t uPos = ((uintptr_t)m_pcCursor + uAlign - 1) & ~(uintptr_t)(uAlign - 1);
+	if (uPos + uBytes > (uintptr_t)m_pcLimit) {
+		//worst case padding included, the new chunk always fits
+		__newChunk(std::max(m_pHead->uSize, uBytes + uAlign));
+		uPos = ((uintptr_t)m_pcCursor + uAlign - 1) & ~(uintptr_t)(uAlign - 1);
+	}
+	m_uUsed += (size_t)(uPos + uBytes - (uintptr_t)m_pcCursor);
+	m_pcCursor = (char*)(uPos + uBytes);
+	return (void*)uPos;
+}
+
+void ScratchArena::do_deallocate(void* pvData, size_t uBytes, size_t uAlign)
+{
+	(void)pvData;
+	(void)uBytes;
+	(void)uAlign;
+}
+
+bool ScratchArena::do_is_equal(const std::pmr::memory_resource& instOther) const noexcept
+{
+	return this == &instOther;
+}
+
+ScratchArena::PChunk ScratchArena::__newChunk(size_t uSize)
+{
+	PChunk pChunk = (PChunk)malloc(sizeof(Chunk) + uSize);
+	if (pChunk == nullptr) {
+		throw std::bad_alloc();
+	}
+	pChunk->pNext = m_pHead;
+	pChunk->uSize = uSize;
+	m_pHead = pChunk;
+	m_pcCursor = (char*)(pChunk + 1);
+	m_pcLimit = m_pcCursor + uSize;
+
+	m_uCapacity.fetch_add(uSize, std::memory_order_relaxed);
+	m_ullChunkAllocs.fetch_add(1, std::memory_order_relaxed);
+	return pChunk;
+}
+
+void ScratchArena::__freeChunks(PChunk pChunk)
+{
+	while (pChunk != nullptr) {
+		PChunk pNext = pChunk->pNext;
+		m_uCapacity.fetch_sub(pChunk->uSize, std::memory_order_relaxed);
+		free(pChunk);
+		pChunk = pNext;
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef SCRATCH_ARENA_H_
+#define SCRATCH_ARENA_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <memory_resource>
+
+#define SCRATCH_ARENA_SIZE (64 * 1024)	//The first chunk of every worker's arena.
+
+/**
+@class	ScratchArena
+@brief	Bump-pointer arena owned by one worker thread.
+						   1.allocate only moves a pointer, deallocate does nothing
+						   2.reset() drops everything at once, the pool calls it after every task
+						   3.when a task outgrew the arena, reset() replaces the chunks by one
+						     chunk of the high-water size, so the next task doesn't overflow again
+@return	None
+-----------------HOW TO USE IT
+	int parseLine(void* pvLine)
+	{
+		//valid until the task returns
+		std::pmr::vector<std::string_view> vecFields(ThreadPool::getScratchResource());
+		char* pcBuf = (char*)ThreadPool::getScratchResource()->allocate(256);
+		...
+	}
+*/
+class ScratchArena : public std::pmr::memory_resource
+{
+public:
+	typedef struct tagScratchStats
+	{
+		size_t             uHighWater;		//most bytes a single task used
+		size_t             uCapacity;		//bytes reserved right now
+		unsigned long long ullChunkAllocs;	//chunks taken from the global allocator
+		unsigned long long ullResets;		//tasks run since start
+	}ScratchStats, *PScratchStats;
+
+	explicit ScratchArena(size_t uChunkSize = SCRATCH_ARENA_SIZE);
+	~ScratchArena();
+
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator= (const ScratchArena&) = delete;
+
+	void reset();							//reset--release every allocation since the last reset
+	size_t used() const { return m_uUsed; }	//bytes handed out since the last reset
+	ScratchStats getStats() const;			//safe to call from any thread
+
+private:
+	typedef struct tagChunk
+	{
+		tagChunk *pNext;
+		size_t    uSize;	//usable bytes after the header
+	}Chunk, *PChunk;
+
+	void* do_allocate(size_t uBytes, size_t uAlign) override;
+	void do_deallocate(void* pvData, size_t uBytes, size_t uAlign) override;
+	bool do_is_equal(const std::pmr::memory_resource& instOther) const noexcept override;
+
+	PChunk __newChunk(size_t uSize);
+	void __freeChunks(PChunk pChunk);
+
+	PChunk                          m_pHead;		//current chunk, older ones follow pNext
+	char                           *m_pcCursor;
+	char                           *m_pcLimit;
+	size_t                          m_uChunkSize;
+	size_t                          m_uUsed;
+	std::atomic<size_t>             m_uHighWater;
+	std::atomic<size_t>             m_uCapacity;
+	std::atomic<unsigned long long> m_ullChunkAllocs;
+	std::atomic<unsigned long long> m_ullResets;
+};
+
+#endif //SCRATCH_ARENA_H_
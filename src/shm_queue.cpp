@@ -0,0 +1,542 @@
+#include "shm_queue.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <chrono>
+#include <new>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+			  "the rings need address-free atomics to work across processes");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "the futex word is a plain uint32_t to the kernel");
+
+typedef struct tagShmCell
+{
+	std::atomic<uint64_t> ullSeq;	//== position: free for that push; == position + 1: holds an item
+	ShmWorkItem           stItem;
+}ShmCell, *PShmCell;
+
+typedef struct tagShmClientSlot
+{
+	std::atomic<int32_t>  iPid;			//0 while free
+	std::atomic<uint32_t> uGeneration;	//bumped by every attach and detach
+	uint64_t              ullArenaOffset;
+	ShmRing               stResults;
+}ShmClientSlot, *PShmClientSlot;
+
+typedef struct tagShmHeader
+{
+	std::atomic<uint64_t> ullMagic;		//written last, a client never maps a half-built region
+	uint32_t              uVersion;
+	uint32_t              uMaxClients;
+	uint64_t              ullArenaSize;
+	uint64_t              ullSize;
+	uint64_t              ullSlotsOffset;
+	ShmRing               stSubmit;
+}ShmHeader, *PShmHeader;
+
+static size_t alignUp(size_t uValue, size_t uAlign)
+{
+	return (uValue + uAlign - 1) & ~(uAlign - 1);
+}
+
+static PShmHeader shmHeader(char* pcBase)
+{
+	return (PShmHeader)pcBase;
+}
+
+static PShmClientSlot shmSlot(char* pcBase, uint32_t uClient)
+{
+	return (PShmClientSlot)(pcBase + shmHeader(pcBase)->ullSlotsOffset) + uClient;
+}
+
+static PShmCell ringCell(char* pcBase, PShmRing pstRing, uint64_t ullPos)
+{
+	return (PShmCell)(pcBase + pstRing->ullCellsOffset) + (ullPos & pstRing->uMask);
+}
+
+static VOID ringInit(char* pcBase, PShmRing pstRing, uint64_t ullCellsOffset, uint32_t uCells)
+{
+	new (pstRing) ShmRing();
+	pstRing->ullTail.store(0, std::memory_order_relaxed);
+	pstRing->ullHead.store(0, std::memory_order_relaxed);
+	pstRing->uFutex.store(0, std::memory_order_relaxed);
+	pstRing->uWaiters.store(0, std::memory_order_relaxed);
+	pstRing->uMask = uCells - 1;
+	pstRing->ullCellsOffset = ullCellsOffset;
+	for (uint32_t i = 0; i < uCells; ++i) {
+		PShmCell pstCell = new (ringCell(pcBase, pstRing, i)) ShmCell();
+		pstCell->ullSeq.store(i, std::memory_order_relaxed);
+	}
+}
+
+static bool ringPush(char* pcBase, PShmRing pstRing, const ShmWorkItem& stItem)
+{
+	uint64_t ullPos = pstRing->ullTail.load(std::memory_order_relaxed);
+	PShmCell pstCell;
+	for (;;) {
+		pstCell = ringCell(pcBase, pstRing, ullPos);
+		int64_t llDiff = (int64_t)(pstCell->ullSeq.load(std::memory_order_acquire) - ullPos);
+		if (llDiff == 0) {
+			if (pstRing->ullTail.compare_exchange_weak(ullPos, ullPos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (llDiff < 0) {
+			return false;		//the cell a lap ago hasn't been popped: full
+		}
+		else {
+			ullPos = pstRing->ullTail.load(std::memory_order_relaxed);
+		}
+	}
+	pstCell->stItem = stItem;
+	pstCell->ullSeq.store(ullPos + 1, std::memory_order_release);
+	return true;
+}
+
+static bool ringPop(char* pcBase, PShmRing pstRing, PShmWorkItem pstItem)
+{
+	uint64_t ullPos = pstRing->ullHead.load(std::memory_order_relaxed);
+	PShmCell pstCell;
+	for (;;) {
+		pstCell = ringCell(pcBase, pstRing, ullPos);
+		int64_t llDiff = (int64_t)(pstCell->ullSeq.load(std::memory_order_acquire) - (ullPos + 1));
+		if (llDiff == 0) {
+			if (pstRing->ullHead.compare_exchange_weak(ullPos, ullPos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (llDiff < 0) {
+			return false;
+		}
+		else {
+			ullPos = pstRing->ullHead.load(std::memory_order_relaxed);
+		}
+	}
+	*pstItem = pstCell->stItem;
+	pstCell->ullSeq.store(ullPos + pstRing->uMask + 1, std::memory_order_release);
+	return true;
+}
+
+static bool ringHasItem(char* pcBase, PShmRing pstRing)
+{
+	uint64_t ullPos = pstRing->ullHead.load(std::memory_order_relaxed);
+	return ringCell(pcBase, pstRing, ullPos)->ullSeq.load(std::memory_order_acquire) == ullPos + 1;
+}
+
+static long futexCall(std::atomic<uint32_t>* puWord, int iOp, uint32_t uValue, const struct timespec* pstTimeout)
+{
+	//no FUTEX_PRIVATE_FLAG, the waiter and the waker are in different processes
+	return syscall(SYS_futex, (uint32_t*)puWord, iOp, uValue, pstTimeout, nullptr, 0);
+}
+
+/*after a push: one atomic add, the syscall only when a consumer sleeps*/
+static VOID ringNotify(PShmRing pstRing)
+{
+	pstRing->uFutex.fetch_add(1, std::memory_order_seq_cst);
+	if (pstRing->uWaiters.load(std::memory_order_seq_cst) != 0) {
+		futexCall(&pstRing->uFutex, FUTEX_WAKE, INT_MAX, nullptr);
+	}
+}
+
+/*
+sleep until a push was notified, the timeout passed or *pbCancel is set (with a ringNotify() after it).
+the futex word is read before the ring is checked, a push in between makes FUTEX_WAIT return at once.
+*/
+static VOID ringWait(char* pcBase, PShmRing pstRing, int iTimeoutMs, const std::atomic<bool>* pbCancel)
+{
+	uint32_t uSeen = pstRing->uFutex.load(std::memory_order_seq_cst);
+	pstRing->uWaiters.fetch_add(1, std::memory_order_seq_cst);
+	if (!ringHasItem(pcBase, pstRing) && (pbCancel == nullptr || !pbCancel->load())) {
+		struct timespec stTimeout = { iTimeoutMs / 1000, (long)(iTimeoutMs % 1000) * 1000000 };
+		futexCall(&pstRing->uFutex, FUTEX_WAIT, uSeen, iTimeoutMs < 0 ? nullptr : &stTimeout);
+	}
+	pstRing->uWaiters.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+/**
+Function:	ShmTaskServer()
+@brief      Constructor of ShmTaskServer. Nothing is shared before create().
+@param[in]  pinstPool:pool the items run on, stConfig:name and sizes of the region
+@param[out] None
+@return     None
+*/
+ShmTaskServer::ShmTaskServer(ThreadPool* pinstPool, const ShmConfig& stConfig):
+	m_pinstPool(pinstPool),
+	m_stConfig(stConfig),
+	m_pcBase(nullptr),
+	m_uSize(0),
+	m_bStop(false),
+	m_uInFlight(0),
+	m_ullReceived(0),
+	m_ullCompleted(0),
+	m_ullFailed(0),
+	m_ullDropped(0),
+	m_ullWakeups(0)
+{
+	uint32_t uRing = 2;
+	while (uRing < m_stConfig.uRingSize && uRing < (1u << 30)) {
+		uRing <<= 1;
+	}
+	m_stConfig.uRingSize = uRing;
+	if (m_stConfig.uMaxClients < 1) {
+		m_stConfig.uMaxClients = 1;
+	}
+	m_stConfig.uArenaSize = alignUp(m_stConfig.uArenaSize, 64);
+	m_fnServe = [this](VOID* pvItem)->int { return __serve(pvItem); };
+}
+
+ShmTaskServer::~ShmTaskServer()
+{
+	__destroy();
+}
+
+VOID ShmTaskServer::registerType(uint32_t uTypeId, Handler_T fnHandler)
+{
+	m_mapHandlers[uTypeId] = fnHandler;
+}
+
+/**
+Function:	create()
+@brief      Create the region, lay out the rings and arenas and start the dispatcher. A region of the
+            same name is a leftover of a server that died, it is unlinked; clients still on it keep their
+            mapping but are never served.
+@param[in]  None
+@param[out] None
+@return     false if the region could not be created or mapped, or create() already ran
+*/
+bool ShmTaskServer::create()
+{
+	if (m_pcBase != nullptr) {
+		return false;
+	}
+	size_t uCellBytes = alignUp((size_t)m_stConfig.uRingSize * sizeof(ShmCell), 64);
+	size_t uSlotsOffset = alignUp(sizeof(ShmHeader), 64) + uCellBytes;
+	size_t uResultsOffset = uSlotsOffset + alignUp(m_stConfig.uMaxClients * sizeof(ShmClientSlot), 64);
+	size_t uArenasOffset = alignUp(uResultsOffset + m_stConfig.uMaxClients * uCellBytes, 4096);
+	size_t uSize = uArenasOffset + m_stConfig.uMaxClients * m_stConfig.uArenaSize;
+
+	shm_unlink(m_stConfig.strName.c_str());
+	int iFd = shm_open(m_stConfig.strName.c_str(), O_CREAT | O_EXCL | O_RDWR, m_stConfig.uMode);
+	if (iFd < 0) {
+		return false;
+	}
+	fchmod(iFd, m_stConfig.uMode);		//past the umask
+	if (ftruncate(iFd, (off_t)uSize) != 0) {
+		close(iFd);
+		shm_unlink(m_stConfig.strName.c_str());
+		return false;
+	}
+	VOID* pvMap = mmap(nullptr, uSize, PROT_READ | PROT_WRITE, MAP_SHARED, iFd, 0);
+	close(iFd);
+	if (pvMap == MAP_FAILED) {
+		shm_unlink(m_stConfig.strName.c_str());
+		return false;
+	}
+	m_pcBase = (char*)pvMap;
+	m_uSize = uSize;
+
+	PShmHeader pstHeader = new (m_pcBase) ShmHeader();
+	pstHeader->uVersion = SHM_QUEUE_VERSION;
+	pstHeader->uMaxClients = m_stConfig.uMaxClients;
+	pstHeader->ullArenaSize = m_stConfig.uArenaSize;
+	pstHeader->ullSize = uSize;
+	pstHeader->ullSlotsOffset = uSlotsOffset;
+	ringInit(m_pcBase, &pstHeader->stSubmit, alignUp(sizeof(ShmHeader), 64), m_stConfig.uRingSize);
+	for (uint32_t i = 0; i < m_stConfig.uMaxClients; ++i) {
+		PShmClientSlot pstSlot = new (shmSlot(m_pcBase, i)) ShmClientSlot();
+		pstSlot->iPid.store(0, std::memory_order_relaxed);
+		pstSlot->uGeneration.store(0, std::memory_order_relaxed);
+		pstSlot->ullArenaOffset = uArenasOffset + i * m_stConfig.uArenaSize;
+		ringInit(m_pcBase, &pstSlot->stResults, uResultsOffset + i * uCellBytes, m_stConfig.uRingSize);
+	}
+	pstHeader->ullMagic.store(SHM_QUEUE_MAGIC, std::memory_order_release);
+
+	m_thrDispatch = std::thread(&ShmTaskServer::__dispatchLoop, this);
+	return true;
+}
+
+VOID ShmTaskServer::__destroy()
+{
+	if (m_pcBase == nullptr) {
+		return;
+	}
+	m_bStop = true;
+	ringNotify(&shmHeader(m_pcBase)->stSubmit);
+	m_thrDispatch.join();
+	{
+		std::unique_lock<std::mutex> uLocker(m_mtxInFlight);
+		m_condInFlight.wait(uLocker, [this] { return m_uInFlight == 0; });
+	}
+	munmap(m_pcBase, m_uSize);
+	shm_unlink(m_stConfig.strName.c_str());
+	m_pcBase = nullptr;
+}
+
+/**
+Function:	__dispatchLoop()
+@brief      Dispatcher thread: move submitted items onto the pool, sleep on the submission futex while
+            the ring is empty.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+VOID ShmTaskServer::__dispatchLoop()
+{
+	PShmRing pstSubmit = &shmHeader(m_pcBase)->stSubmit;
+	while (!m_bStop.load()) {
+		ShmWorkItem stItem;
+		UINT uMoved = 0;
+		while (uMoved < SHM_QUEUE_DISPATCH_BATCH && ringPop(m_pcBase, pstSubmit, &stItem)) {
+			{
+				std::lock_guard<std::mutex> guard(m_mtxInFlight);
+				m_uInFlight++;
+			}
+			m_pinstPool->addTask(m_fnServe, new ShmWorkItem(stItem), "shm");
+			uMoved++;
+		}
+		m_ullReceived += uMoved;
+		if (uMoved == 0) {
+			ringWait(m_pcBase, pstSubmit, -1, &m_bStop);
+			m_ullWakeups++;
+		}
+	}
+}
+
+/**
+Function:	__serve()
+@brief      Run one item's handler on its payload and push the item, status and result filled in,
+            to the submitting client's result ring.
+@param[in]  pvItem:heap copy made by the dispatcher, deleted here
+@param[out] None
+@return     0
+*/
+int ShmTaskServer::__serve(VOID* pvItem)
+{
+	PShmWorkItem pstItem = (PShmWorkItem)pvItem;
+	PShmHeader pstHeader = shmHeader(m_pcBase);
+	if (pstItem->uClient < pstHeader->uMaxClients) {		//the region is writable by every client, check what they wrote
+		PShmClientSlot pstSlot = shmSlot(m_pcBase, pstItem->uClient);
+		auto itHandler = m_mapHandlers.find(pstItem->uTypeId);
+		if (itHandler == m_mapHandlers.end()) {
+			pstItem->uStatus = SHM_STATUS_UNKNOWN_TYPE;
+		}
+		else if (pstItem->ullOffset > pstHeader->ullArenaSize || pstItem->ullLength > pstHeader->ullArenaSize - pstItem->ullOffset) {
+			pstItem->uStatus = SHM_STATUS_BAD_PAYLOAD;
+		}
+		else {
+			pstItem->llResult = itHandler->second(m_pcBase + pstSlot->ullArenaOffset + pstItem->ullOffset, (size_t)pstItem->ullLength);
+			pstItem->uStatus = SHM_STATUS_DONE;
+		}
+		(pstItem->uStatus == SHM_STATUS_DONE ? m_ullCompleted : m_ullFailed)++;
+
+		if (pstSlot->uGeneration.load(std::memory_order_acquire) == pstItem->uGeneration &&
+			ringPush(m_pcBase, &pstSlot->stResults, *pstItem)) {
+			ringNotify(&pstSlot->stResults);
+		}
+		else {
+			m_ullDropped++;
+		}
+	}
+	else {
+		m_ullFailed++;
+		m_ullDropped++;
+	}
+	delete pstItem;
+
+	std::lock_guard<std::mutex> guard(m_mtxInFlight);
+	if (--m_uInFlight == 0) {
+		m_condInFlight.notify_all();
+	}
+	return 0;
+}
+
+ShmTaskServer::ShmServerStats ShmTaskServer::getStats()
+{
+	ShmServerStats stStats;
+	stStats.ullReceived = m_ullReceived.load();
+	stStats.ullCompleted = m_ullCompleted.load();
+	stStats.ullFailed = m_ullFailed.load();
+	stStats.ullDropped = m_ullDropped.load();
+	stStats.ullWakeups = m_ullWakeups.load();
+	return stStats;
+}
+
+ShmTaskClient::ShmTaskClient():
+	m_pcBase(nullptr),
+	m_uSize(0),
+	m_uClient(0),
+	m_uGeneration(0),
+	m_uOutstanding(0)
+{
+}
+
+ShmTaskClient::~ShmTaskClient()
+{
+	detach();
+}
+
+/**
+Function:	attach()
+@brief      Map the region of a running server and take a client slot. A slot whose process is gone
+            is taken over, results still addressed to it are skipped by their generation.
+@param[in]  pcName:the server's shm_open name
+@param[out] None
+@return     false if there is no such region, its layout differs or every slot is taken
+*/
+bool ShmTaskClient::attach(const char* pcName)
+{
+	if (m_pcBase != nullptr) {
+		return false;
+	}
+	int iFd = shm_open(pcName, O_RDWR, 0);
+	if (iFd < 0) {
+		return false;
+	}
+	struct stat stStat;
+	VOID* pvMap = MAP_FAILED;
+	if (fstat(iFd, &stStat) == 0 && (size_t)stStat.st_size >= sizeof(ShmHeader)) {
+		pvMap = mmap(nullptr, (size_t)stStat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, iFd, 0);
+	}
+	close(iFd);
+	if (pvMap == MAP_FAILED) {
+		return false;
+	}
+	char* pcBase = (char*)pvMap;
+	PShmHeader pstHeader = shmHeader(pcBase);
+	if (pstHeader->ullMagic.load(std::memory_order_acquire) != SHM_QUEUE_MAGIC ||
+		pstHeader->uVersion != SHM_QUEUE_VERSION || pstHeader->ullSize != (uint64_t)stStat.st_size) {
+		munmap(pvMap, (size_t)stStat.st_size);
+		return false;
+	}
+
+	int32_t iSelf = (int32_t)getpid();
+	for (uint32_t i = 0; i < pstHeader->uMaxClients; ++i) {
+		PShmClientSlot pstSlot = shmSlot(pcBase, i);
+		int32_t iPid = pstSlot->iPid.load();
+		if (iPid != 0 && !(kill(iPid, 0) != 0 && errno == ESRCH)) {
+			continue;
+		}
+		if (!pstSlot->iPid.compare_exchange_strong(iPid, iSelf)) {
+			continue;
+		}
+		m_pcBase = pcBase;
+		m_uSize = (size_t)stStat.st_size;
+		m_uClient = i;
+		m_uGeneration = pstSlot->uGeneration.fetch_add(1) + 1;
+		m_uOutstanding = 0;
+		return true;
+	}
+	munmap(pvMap, (size_t)stStat.st_size);
+	return false;
+}
+
+VOID ShmTaskClient::detach()
+{
+	if (m_pcBase == nullptr) {
+		return;
+	}
+	PShmClientSlot pstSlot = shmSlot(m_pcBase, m_uClient);
+	pstSlot->uGeneration.fetch_add(1);		//results on their way are dropped by the server
+	pstSlot->iPid.store(0);
+	munmap(m_pcBase, m_uSize);
+	m_pcBase = nullptr;
+}
+
+char* ShmTaskClient::getArena(size_t* puSize)
+{
+	if (m_pcBase == nullptr) {
+		return nullptr;
+	}
+	if (puSize != nullptr) {
+		*puSize = (size_t)shmHeader(m_pcBase)->ullArenaSize;
+	}
+	return m_pcBase + shmSlot(m_pcBase, m_uClient)->ullArenaOffset;
+}
+
+/**
+Function:	submit()
+@brief      Push one item to the server. The payload must already be in the arena.
+@param[in]  uTypeId:handler on the server, ullTag:comes back with the result,
+            ullOffset/ullLength:payload inside getArena()
+@param[out] None
+@return     false if not attached, the submission ring is full or uRingSize results are uncollected
+*/
+bool ShmTaskClient::submit(uint32_t uTypeId, uint64_t ullTag, uint64_t ullOffset, uint64_t ullLength)
+{
+	if (m_pcBase == nullptr) {
+		return false;
+	}
+	PShmRing pstSubmit = &shmHeader(m_pcBase)->stSubmit;
+	if (m_uOutstanding > pstSubmit->uMask) {
+		return false;		//the result ring could overflow
+	}
+	ShmWorkItem stItem;
+	stItem.uTypeId = uTypeId;
+	stItem.uClient = m_uClient;
+	stItem.uGeneration = m_uGeneration;
+	stItem.uStatus = SHM_STATUS_PENDING;
+	stItem.ullTag = ullTag;
+	stItem.ullOffset = ullOffset;
+	stItem.ullLength = ullLength;
+	stItem.llResult = 0;
+	if (!ringPush(m_pcBase, pstSubmit, stItem)) {
+		return false;
+	}
+	ringNotify(pstSubmit);
+	m_uOutstanding++;
+	return true;
+}
+
+bool ShmTaskClient::tryResult(PShmWorkItem pstResult)
+{
+	if (m_pcBase == nullptr) {
+		return false;
+	}
+	PShmRing pstResults = &shmSlot(m_pcBase, m_uClient)->stResults;
+	while (ringPop(m_pcBase, pstResults, pstResult)) {
+		if (pstResult->uGeneration == m_uGeneration) {
+			m_uOutstanding--;
+			return true;
+		}
+		//for the process that had the slot before
+	}
+	return false;
+}
+
+/**
+Function:	waitResult()
+@brief      Collect one result, sleeping on the result ring's futex while there is none.
+@param[in]  iTimeoutMs:-1 waits for good
+@param[out] pstResult:the submitted item with uStatus and llResult filled in
+@return     false on timeout or without anything outstanding
+*/
+bool ShmTaskClient::waitResult(PShmWorkItem pstResult, int iTimeoutMs)
+{
+	auto Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(iTimeoutMs < 0 ? 0 : iTimeoutMs);
+	while (!tryResult(pstResult)) {
+		if (m_pcBase == nullptr || m_uOutstanding == 0) {
+			return false;
+		}
+		int iLeftMs = -1;
+		if (iTimeoutMs >= 0) {
+			iLeftMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(Deadline - std::chrono::steady_clock::now()).count();
+			if (iLeftMs <= 0) {
+				return tryResult(pstResult);
+			}
+		}
+		ringWait(m_pcBase, &shmSlot(m_pcBase, m_uClient)->stResults, iLeftMs, nullptr);
+	}
+	return true;
+}
+
+#endif //__linux__
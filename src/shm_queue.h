@@ -0,0 +1,184 @@
+#ifndef SHM_QUEUE_H_
+#define SHM_QUEUE_H_
+
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "thread_pool.h"
+
+#define SHM_QUEUE_MAGIC (0x5953505155455545ull)	//"YSPQUEUE", a region of another layout is refused
+#define SHM_QUEUE_VERSION (1)
+#define SHM_QUEUE_DISPATCH_BATCH (64)			//Items the dispatcher moves to the pool per wakeup.
+
+/*
+fixed-format work item, the same struct goes in through the submission ring and comes back through
+the client's result ring. the payload is ullLength bytes at ullOffset of the client's arena, the
+handler may write its output there too.
+*/
+typedef struct tagShmWorkItem
+{
+	uint32_t uTypeId;
+	uint32_t uClient;		//slot of the submitting client, filled in by submit()
+	uint32_t uGeneration;	//of that slot, results for a client that left are dropped
+	uint32_t uStatus;		//ShmStatus_E, set on the way back
+	uint64_t ullTag;		//the client's own id for the request
+	uint64_t ullOffset;
+	uint64_t ullLength;
+	int64_t  llResult;		//handler's return value
+}ShmWorkItem, *PShmWorkItem;
+
+typedef enum tagShmStatus
+{
+	SHM_STATUS_PENDING,
+	SHM_STATUS_DONE,
+	SHM_STATUS_UNKNOWN_TYPE,
+	SHM_STATUS_BAD_PAYLOAD		//offset/length outside the client's arena
+}ShmStatus_E;
+
+/*
+bounded multi-producer multi-consumer ring (D. Vyukov's, one sequence number per cell) that lives
+in the shared region; processes only share offsets, never pointers. a consumer sleeps on uFutex,
+a process-shared futex bumped by every push.
+*/
+typedef struct tagShmRing
+{
+	alignas(64) std::atomic<uint64_t> ullTail;		//next cell to claim for a push
+	alignas(64) std::atomic<uint64_t> ullHead;		//next cell to pop
+	alignas(64) std::atomic<uint32_t> uFutex;
+	std::atomic<uint32_t>             uWaiters;
+	uint32_t                          uMask;
+	uint64_t                          ullCellsOffset;	//from the region base
+}ShmRing, *PShmRing;
+
+/**
+@class	ShmTaskServer
+@brief	Owner side of a cross-process task queue: one pool serves the submissions of every local process.
+						   1.create() makes the shm_open region: header, submission ring, per-client
+						     result rings and per-client payload arenas
+						   2.a dispatcher thread sleeps on the submission futex and moves up to
+						     SHM_QUEUE_DISPATCH_BATCH items per wakeup onto the pool
+						   3.a pool task runs the type's handler on the payload in the client's arena
+						     and pushes the item with its result to the client's ring, waking the client
+						   4.a client has at most uRingSize items outstanding, a result ring never overflows
+						   5.the region goes with the server; a process that dies halfway through a push
+						     stalls the ring it was pushing to
+@return	None
+-----------------HOW TO USE IT
+	ShmTaskServer::ShmConfig stConfig;
+	stConfig.strName = "/ingest-tasks";
+	ShmTaskServer instServer(ThreadPool::getInstance(), stConfig);
+	instServer.registerType(MSG_RESIZE, [](VOID* pvPayload, size_t uLen)->int64_t { ...; return 0; });
+	instServer.create();		//clients may attach from now on
+
+	//in a helper process
+	ShmTaskClient instClient;
+	instClient.attach("/ingest-tasks");
+	char* pcArena = instClient.getArena(nullptr);
+	memcpy(pcArena, &stRequest, sizeof(stRequest));
+	instClient.submit(MSG_RESIZE, ullMyTag, 0, sizeof(stRequest));
+	ShmWorkItem stDone;
+	instClient.waitResult(&stDone, 1000);
+*/
+class ShmTaskServer
+{
+public:
+	typedef std::function<int64_t(VOID*, size_t)> Handler_T;
+	typedef struct tagShmConfig
+	{
+		std::string strName;		//shm_open name, "/something"
+		UINT        uRingSize;		//rounded up to a power of two, for every ring
+		UINT        uMaxClients;
+		size_t      uArenaSize;		//payload bytes per client
+		mode_t      uMode;			//of the shm object, the clients' user needs read/write
+		tagShmConfig():
+			strName("/ysp-tasks"),
+			uRingSize(1024),
+			uMaxClients(16),
+			uArenaSize(1u << 20),
+			uMode(0600)
+		{
+		}
+	}ShmConfig, *PShmConfig;
+	typedef struct tagShmServerStats
+	{
+		unsigned long long ullReceived;
+		unsigned long long ullCompleted;
+		unsigned long long ullFailed;		//unknown type or bad payload
+		unsigned long long ullDropped;		//the client left before its result
+		unsigned long long ullWakeups;		//times the dispatcher came back from the futex
+	}ShmServerStats, *PShmServerStats;
+
+	ShmTaskServer(ThreadPool* pinstPool, const ShmConfig& stConfig);
+	~ShmTaskServer();		//stops dispatching, waits for the queued items and removes the region
+
+	ShmTaskServer(const ShmTaskServer&) = delete;
+	ShmTaskServer& operator= (const ShmTaskServer&) = delete;
+
+	VOID registerType(uint32_t uTypeId, Handler_T fnHandler);	//registerType--before create()
+	bool create();				//create--replace a stale region of the same name and start the dispatcher
+	ShmServerStats getStats();
+
+private:
+	VOID __dispatchLoop();
+	int  __serve(VOID* pvItem);		//__serve--pool task, runs one item and returns it to its client
+	VOID __destroy();
+
+	ThreadPool                              *m_pinstPool;
+	ShmConfig                                m_stConfig;
+	std::unordered_map<uint32_t, Handler_T>  m_mapHandlers;	//read only once create() ran
+	char                                    *m_pcBase;
+	size_t                                   m_uSize;
+	std::thread                              m_thrDispatch;
+	std::atomic<bool>                        m_bStop;
+	std::mutex                               m_mtxInFlight;
+	std::condition_variable                  m_condInFlight;
+	size_t                                   m_uInFlight;	//on the pool, guarded by m_mtxInFlight
+	ThreadPool::CallBack_T                   m_fnServe;
+	std::atomic<unsigned long long>          m_ullReceived;
+	std::atomic<unsigned long long>          m_ullCompleted;
+	std::atomic<unsigned long long>          m_ullFailed;
+	std::atomic<unsigned long long>          m_ullDropped;
+	std::atomic<unsigned long long>          m_ullWakeups;
+};
+
+/**
+@class	ShmTaskClient
+@brief	Submitting side, in any process of a user that may open the region. Not thread-safe, one per thread.
+@return	None
+*/
+class ShmTaskClient
+{
+public:
+	ShmTaskClient();
+	~ShmTaskClient();		//detach()
+
+	ShmTaskClient(const ShmTaskClient&) = delete;
+	ShmTaskClient& operator= (const ShmTaskClient&) = delete;
+
+	bool attach(const char* pcName);	//attach--map the region and take a free client slot, or one of a dead process
+	VOID detach();						//detach--results still on their way are dropped
+
+	char* getArena(size_t* puSize);		//getArena--this client's payload memory, offsets in submit() are into it
+	bool submit(uint32_t uTypeId, uint64_t ullTag, uint64_t ullOffset, uint64_t ullLength);	//submit--false if full or too many outstanding
+	bool tryResult(PShmWorkItem pstResult);
+	bool waitResult(PShmWorkItem pstResult, int iTimeoutMs);	//waitResult--iTimeoutMs < 0 waits for good
+	UINT getOutstanding() { return m_uOutstanding; }
+
+private:
+	char     *m_pcBase;
+	size_t    m_uSize;
+	uint32_t  m_uClient;
+	uint32_t  m_uGeneration;
+	UINT      m_uOutstanding;	//submitted and not yet collected
+};
+
+#endif //__linux__
+#endif //SHM_QUEUE_H_
@@ -0,0 +1,267 @@
+#include "spill_queue.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic>
+
+typedef struct tagSpillHeader
+{
+	uint32_t uTypeId;
+	uint32_t uLen;
+}SpillHeader;
+
+static size_t spillRecordSize(size_t uLen)
+{
+	return (sizeof(SpillHeader) + uLen + 7) & ~(size_t)7;
+}
+
+static std::atomic<UINT> s_uNextQueueId(0);
+
+/**
+Function:	SpillTaskQueue()
+@brief      Constructor of SpillTaskQueue. No file is created before the budget is exceeded.
+@param[in]  pinstPool:pool the records run on, stConfig:budget and spill location
+@param[out] None
+@return     None
+*/
+SpillTaskQueue::SpillTaskQueue(ThreadPool* pinstPool, const SpillConfig& stConfig):
+	m_pinstPool(pinstPool),
+	m_stConfig(stConfig),
+	m_uDrainers(0),
+	m_uSegmentSeq(0),
+	m_uQueueId(s_uNextQueueId++)
+{
+	if (m_stConfig.uMaxDrainers < 1) {
+		m_stConfig.uMaxDrainers = 1;
+	}
+	memset(&m_stStats, 0, sizeof(m_stStats));
+	m_fnDrain = [this](VOID* pvArg)->int { return __drain(pvArg); };
+}
+
+/**
+Function:	~SpillTaskQueue()
+@brief      Destructor of SpillTaskQueue. Every pushed record runs first.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+SpillTaskQueue::~SpillTaskQueue()
+{
+	flush();
+	std::lock_guard<std::mutex> guard(m_mtxQueue);
+	while (!m_qSegments.empty()) {
+		__closeSegment();
+	}
+}
+
+VOID SpillTaskQueue::registerType(uint32_t uTypeId, Handler_T fnHandler)
+{
+	std::lock_guard<std::mutex> guard(m_mtxQueue);
+	m_mapHandlers[uTypeId] = fnHandler;
+}
+
+/**
+Function:	push()
+@brief      Queue a record. It stays in memory while the budget allows and nothing is spilled,
+            otherwise it is appended to the newest segment.
+@param[in]  uTypeId:registered type, pvPayload/uLen:bytes copied as they are
+@param[out] None
+@return     false for an unknown type, a record larger than a segment or a failed segment file
+*/
+bool SpillTaskQueue::push(uint32_t uTypeId, const VOID* pvPayload, size_t uLen)
+{
+	std::lock_guard<std::mutex> guard(m_mtxQueue);
+	if (m_mapHandlers.find(uTypeId) == m_mapHandlers.end() ||
+		spillRecordSize(uLen) > m_stConfig.uSegmentSize || uLen >= UINT32_MAX) {
+		return false;
+	}
+
+	size_t uCost = sizeof(Record) + uLen;
+	if (m_qSegments.empty() && m_stStats.uMemoryBytes + uCost <= m_stConfig.uMemoryBudget) {
+		Record stRecord;
+		stRecord.uTypeId = uTypeId;
+		stRecord.vecPayload.assign((const unsigned char*)pvPayload, (const unsigned char*)pvPayload + uLen);
+		m_qMemory.push_back(std::move(stRecord));
+		m_stStats.uMemoryBytes += uCost;
+		m_stStats.uMemoryPeak = (std::max)(m_stStats.uMemoryPeak, m_stStats.uMemoryBytes);
+	}
+	else if (!__spill(uTypeId, pvPayload, uLen)) {
+		return false;
+	}
+	m_stStats.ullPushed++;
+	__postDrainers();
+	return true;
+}
+
+VOID SpillTaskQueue::flush()
+{
+	std::unique_lock<std::mutex> uLocker(m_mtxQueue);
+	m_condIdle.wait(uLocker, [this] { return m_uDrainers == 0; });
+}
+
+SpillTaskQueue::SpillStats SpillTaskQueue::getStats()
+{
+	std::lock_guard<std::mutex> guard(m_mtxQueue);
+	m_stStats.uSegments = m_qSegments.size();
+	return m_stStats;
+}
+
+/**
+Function:	__drain()
+@brief      Run records in queue order, refilling from the segments when the window runs dry.
+            After SPILL_DRAIN_BATCH records it queues itself again so other tasks get a worker.
+@param[in]  pvArg:unused
+@param[out] None
+@return     0
+*/
+int SpillTaskQueue::__drain(VOID* pvArg)
+{
+	for (int i = 0; i < SPILL_DRAIN_BATCH; ++i) {
+		Record stRecord;
+		Handler_T* pfnHandler;
+		{
+			std::lock_guard<std::mutex> guard(m_mtxQueue);
+			if (i != 0) {
+				m_stStats.ullRun++;		//the record run in the previous round
+			}
+			if (m_qMemory.empty() && !__refill()) {
+				if (--m_uDrainers == 0) {
+					m_condIdle.notify_all();
+				}
+				return 0;
+			}
+			stRecord = std::move(m_qMemory.front());
+			m_qMemory.pop_front();
+			m_stStats.uMemoryBytes -= sizeof(Record) + stRecord.vecPayload.size();
+			pfnHandler = &m_mapHandlers[stRecord.uTypeId];
+		}
+		(*pfnHandler)(stRecord.vecPayload.data(), stRecord.vecPayload.size());
+	}
+
+	std::lock_guard<std::mutex> guard(m_mtxQueue);
+	m_stStats.ullRun++;
+	m_pinstPool->addTask(m_fnDrain, nullptr, "spill");
+	return 0;
+}
+
+bool SpillTaskQueue::__spill(uint32_t uTypeId, const VOID* pvPayload, size_t uLen)
+{
+	size_t uNeed = spillRecordSize(uLen);
+	if (m_qSegments.empty() || m_qSegments.back().uWriteOff + uNeed > m_stConfig.uSegmentSize) {
+		if (!__openSegment()) {
+			return false;
+		}
+	}
+	Segment& stSegment = m_qSegments.back();
+	SpillHeader stHeader = { uTypeId, (uint32_t)uLen };
+	memcpy(stSegment.pcBase + stSegment.uWriteOff, &stHeader, sizeof(stHeader));
+	memcpy(stSegment.pcBase + stSegment.uWriteOff + sizeof(stHeader), pvPayload, uLen);
+	stSegment.uWriteOff += uNeed;
+	m_stStats.uSpillBytes += uNeed;
+	m_stStats.ullSpilled++;
+	__release(&stSegment, &stSegment.uWriteReleased, stSegment.uWriteOff);
+	return true;
+}
+
+/**
+Function:	__refill()
+@brief      Read records from the oldest segment into memory up to the budget, at least one.
+            A segment read to its end is closed, once none is left push() keeps records in memory again.
+@param[in]  None
+@param[out] None
+@return     false if nothing was spilled
+*/
+bool SpillTaskQueue::__refill()
+{
+	if (m_qSegments.empty()) {
+		return false;
+	}
+	Segment& stSegment = m_qSegments.front();
+	while (stSegment.uReadOff < stSegment.uWriteOff) {
+		SpillHeader stHeader;
+		memcpy(&stHeader, stSegment.pcBase + stSegment.uReadOff, sizeof(stHeader));
+		size_t uCost = sizeof(Record) + stHeader.uLen;
+		if (!m_qMemory.empty() && m_stStats.uMemoryBytes + uCost > m_stConfig.uMemoryBudget) {
+			break;
+		}
+		const unsigned char* pucPayload = (const unsigned char*)stSegment.pcBase + stSegment.uReadOff + sizeof(stHeader);
+		Record stRecord;
+		stRecord.uTypeId = stHeader.uTypeId;
+		stRecord.vecPayload.assign(pucPayload, pucPayload + stHeader.uLen);
+		m_qMemory.push_back(std::move(stRecord));
+		m_stStats.uMemoryBytes += uCost;
+		m_stStats.uMemoryPeak = (std::max)(m_stStats.uMemoryPeak, m_stStats.uMemoryBytes);
+
+		size_t uNeed = spillRecordSize(stHeader.uLen);
+		stSegment.uReadOff += uNeed;
+		m_stStats.uSpillBytes -= uNeed;
+	}
+	__release(&stSegment, &stSegment.uReadReleased, stSegment.uReadOff);
+	if (stSegment.uReadOff == stSegment.uWriteOff) {
+		__closeSegment();
+	}
+	return true;
+}
+
+bool SpillTaskQueue::__openSegment()
+{
+	std::string strPath = m_stConfig.strDir + "/spill-" + std::to_string(getpid()) + "-" +
+	                      std::to_string(m_uQueueId) + "-" + std::to_string(m_uSegmentSeq++) + ".seg";
+	int iFd = open(strPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (iFd < 0) {
+		return false;
+	}
+	//nobody else opens it and a crash shouldn't leave it behind
+	unlink(strPath.c_str());
+	if (ftruncate(iFd, (off_t)m_stConfig.uSegmentSize) != 0) {
+		close(iFd);
+		return false;
+	}
+	VOID* pvBase = mmap(nullptr, m_stConfig.uSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, iFd, 0);
+	if (pvBase == MAP_FAILED) {
+		close(iFd);
+		return false;
+	}
+	Segment stSegment = { iFd, (char*)pvBase, 0, 0, 0, 0 };
+	m_qSegments.push_back(stSegment);
+	return true;
+}
+
+VOID SpillTaskQueue::__closeSegment()
+{
+	Segment& stSegment = m_qSegments.front();
+	munmap(stSegment.pcBase, m_stConfig.uSegmentSize);
+	close(stSegment.iFd);
+	m_qSegments.pop_front();
+}
+
+/**
+Function:	__release()
+@brief      Drop whole pages below uUpTo from the mapping once a chunk has collected. The data
+            stays in the file, a later read faults it back in from the page cache.
+@param[in]  pstSegment:the segment, uUpTo:offset written or read up to
+@param[out] puReleased:offset released up to
+@return     None
+*/
+VOID SpillTaskQueue::__release(PSegment pstSegment, size_t* puReleased, size_t uUpTo)
+{
+	static const size_t s_uPage = (size_t)sysconf(_SC_PAGESIZE);
+	size_t uEnd = uUpTo / s_uPage * s_uPage;
+	if (uEnd >= *puReleased + SPILL_RELEASE_CHUNK) {
+		madvise(pstSegment->pcBase + *puReleased, uEnd - *puReleased, MADV_DONTNEED);
+		*puReleased = uEnd;
+	}
+}
+
+VOID SpillTaskQueue::__postDrainers()
+{
+	size_t uPending = m_qMemory.size() + (m_qSegments.empty() ? 0 : 1);
+	while (m_uDrainers < m_stConfig.uMaxDrainers && m_uDrainers < uPending) {
+		m_uDrainers++;
+		m_pinstPool->addTask(m_fnDrain, nullptr, "spill");
+	}
+}
+#endif
@@ -0,0 +1,123 @@
+#ifndef SPILL_QUEUE_H_
+#define SPILL_QUEUE_H_
+
+#ifdef __linux__
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "thread_pool.h"
+
+#define SPILL_SEGMENT_SIZE (64u << 20)		//Default size of one overflow segment file.
+#define SPILL_RELEASE_CHUNK (1u << 20)		//Mapped pages are dropped from RSS in chunks of this size.
+#define SPILL_DRAIN_BATCH (64)				//Records a drain task runs before it requeues itself.
+
+/**
+@class	SpillTaskQueue
+@brief	Queue of serializable tasks (a type id and a POD payload) with a fixed memory budget.
+						   1.records are kept in memory until uMemoryBudget bytes are queued
+						   2.past that they are appended to mmap'd segment files in strDir, producers never block
+						   3.once spilling started every new record goes to the file too, order stays FIFO
+						   4.drain tasks on the pool run the records; an empty window is refilled from the
+						     oldest segment, a consumed segment is unmapped and closed
+						     (the files are unlinked right after creation, a crash leaves nothing behind)
+						   5.written and read pages are dropped from the mapping every SPILL_RELEASE_CHUNK,
+						     the page cache holds the backlog instead of the process
+@return	None
+-----------------HOW TO USE IT
+	SpillTaskQueue::SpillConfig stConfig;
+	stConfig.uMemoryBudget = 16 << 20;
+	stConfig.strDir = "/var/tmp";
+	SpillTaskQueue instQueue(ThreadPool::getInstance(), stConfig);
+	instQueue.registerType(MSG_INGEST, [](const VOID* pvPayload, size_t uLen)->int { ...; return 0; });
+
+	IngestMsg stMsg = { ... };		//POD, copied byte for byte
+	instQueue.push(MSG_INGEST, &stMsg, sizeof(stMsg));
+	...
+	instQueue.flush();				//wait until everything pushed so far has run
+*/
+class SpillTaskQueue
+{
+public:
+	typedef std::function<int(const VOID*, size_t)> Handler_T;
+	typedef struct tagSpillConfig
+	{
+		size_t      uMemoryBudget;		//payload plus bookkeeping bytes kept in memory
+		std::string strDir;				//where the segment files go
+		size_t      uSegmentSize;		//a record must fit in one segment
+		UINT        uMaxDrainers;		//drain tasks on the pool at once, 1 runs records in order
+		tagSpillConfig():
+			uMemoryBudget(4u << 20),
+			strDir("/tmp"),
+			uSegmentSize(SPILL_SEGMENT_SIZE),
+			uMaxDrainers(1)
+		{
+		}
+	}SpillConfig, *PSpillConfig;
+	typedef struct tagSpillStats
+	{
+		size_t             uMemoryBytes;
+		size_t             uMemoryPeak;
+		unsigned long long ullPushed;
+		unsigned long long ullSpilled;		//records that went through a segment file
+		unsigned long long ullRun;
+		size_t             uSpillBytes;		//written and not yet read back
+		size_t             uSegments;		//segment files open
+	}SpillStats, *PSpillStats;
+
+	SpillTaskQueue(ThreadPool* pinstPool, const SpillConfig& stConfig);
+	~SpillTaskQueue();
+
+	SpillTaskQueue(const SpillTaskQueue&) = delete;
+	SpillTaskQueue& operator= (const SpillTaskQueue&) = delete;
+
+	VOID registerType(uint32_t uTypeId, Handler_T fnHandler);		//registerType--before the first push of that type
+	bool push(uint32_t uTypeId, const VOID* pvPayload, size_t uLen);	//push--false if the record can't be kept anywhere
+	VOID flush();								//flush--wait until every record pushed so far has run
+	SpillStats getStats();
+
+private:
+	typedef struct tagRecord
+	{
+		uint32_t                   uTypeId;
+		std::vector<unsigned char> vecPayload;
+	}Record, *PRecord;
+	typedef struct tagSegment
+	{
+		int         iFd;			//already unlinked, the file goes with the last close
+		char       *pcBase;
+		size_t      uWriteOff;
+		size_t      uReadOff;
+		size_t      uWriteReleased;		//pages below this are out of the mapping
+		size_t      uReadReleased;
+	}Segment, *PSegment;
+
+	int  __drain(VOID* pvArg);			//__drain--pool task, runs up to SPILL_DRAIN_BATCH records
+	bool __spill(uint32_t uTypeId, const VOID* pvPayload, size_t uLen);
+	bool __refill();					//__refill--move records from the oldest segment into memory
+	bool __openSegment();
+	VOID __closeSegment();				//__closeSegment--drop the oldest segment
+	VOID __release(PSegment pstSegment, size_t* puReleased, size_t uUpTo);
+	VOID __postDrainers();
+
+	ThreadPool                                   *m_pinstPool;
+	SpillConfig                                   m_stConfig;
+	std::mutex                                    m_mtxQueue;
+	std::condition_variable                       m_condIdle;
+	std::unordered_map<uint32_t, Handler_T>       m_mapHandlers;
+	std::deque<Record>                            m_qMemory;
+	std::deque<Segment>                           m_qSegments;	//front is read, back is written
+	ThreadPool::CallBack_T                        m_fnDrain;
+	UINT                                          m_uDrainers;	//drain tasks queued or running
+	UINT                                          m_uSegmentSeq;
+	UINT                                          m_uQueueId;
+	SpillStats                                    m_stStats;
+};
+
+#endif //__linux__
+#endif //SPILL_QUEUE_H_
@@ -0,0 +1,109 @@
+#include "task_group.h"
+
+static thread_local UINT tl_uHelpDepth = 0;	//unrelated tasks run by waits on this thread's stack
+
+/**
+Function:	TaskGroup()
+@brief      Constructor of TaskGroup.
+@param[in]  pinstPool:pool the proxies of the children are queued on
+@param[out] None
+@return     None
+*/
+TaskGroup::TaskGroup(ThreadPool* pinstPool):
+	m_pinstPool(pinstPool),
+	m_pState(std::make_shared<GroupState>())
+{
+	m_pState->uPending = 0;
+}
+
+TaskGroup::~TaskGroup()
+{
+	wait();
+}
+
+UINT TaskGroup::getHelpDepth()
+{
+	return tl_uHelpDepth;
+}
+
+/**
+Function:	run()
+@brief      Fork a child. It stays in the group until the waiter or the proxy task takes it,
+            a proxy finding nothing left just returns.
+@param[in]  pfnProc/pvArg:the child
+@param[out] None
+@return     None
+*/
+VOID TaskGroup::run(CallBack_T pfnProc, VOID* pvArg)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_pState->mtxState);
+		m_pState->qChildren.emplace_back(pfnProc, pvArg, "child");
+		m_pState->uPending++;
+	}
+	m_pState->condState.notify_all();
+
+	std::shared_ptr<GroupState> pState = m_pState;
+	m_pinstPool->addTask([pState](VOID*)->int { __runChild(pState); return 0; }, nullptr, "fork");
+}
+
+/**
+Function:	wait()
+@brief      Return once every child forked so far has finished. Until then the calling thread
+            runs unstarted children of this group, then other queued tasks while it is less than
+            TASK_GROUP_MAX_HELP_DEPTH levels deep, and sleeps only when there is nothing to run.
+@param[in]  None
+@param[out] None
+@return     None
+*/
+VOID TaskGroup::wait()
+{
+	//tasks this worker took in its batch would otherwise wait for us
+	ThreadPool::releaseBatch();
+
+	while (true) {
+		{
+			std::lock_guard<std::mutex> guard(m_pState->mtxState);
+			if (m_pState->uPending == 0) {
+				return;
+			}
+		}
+		if (__runChild(m_pState)) {
+			continue;
+		}
+		if (tl_uHelpDepth < TASK_GROUP_MAX_HELP_DEPTH) {
+			++tl_uHelpDepth;
+			bool bRan = m_pinstPool->runPendingTask();
+			--tl_uHelpDepth;
+			if (bRan) {
+				continue;
+			}
+		}
+
+		//every child is running on some other thread, which makes progress on its own
+		std::unique_lock<std::mutex> uLocker(m_pState->mtxState);
+		m_pState->condState.wait(uLocker, [this] { return m_pState->uPending == 0 ||
+														  !m_pState->qChildren.empty(); });
+	}
+}
+
+bool TaskGroup::__runChild(const std::shared_ptr<GroupState>& pState)
+{
+	ThreadPool::Task stChild;
+	{
+		std::lock_guard<std::mutex> guard(pState->mtxState);
+		if (pState->qChildren.empty()) {
+			return false;
+		}
+		stChild = pState->qChildren.front();
+		pState->qChildren.pop_front();
+	}
+
+	stChild.pfnProc(stChild.pvArg);
+
+	std::lock_guard<std::mutex> guard(pState->mtxState);
+	if (--pState->uPending == 0) {
+		pState->condState.notify_all();
+	}
+	return true;
+}
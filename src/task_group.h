@@ -0,0 +1,71 @@
+#ifndef TASK_GROUP_H_
+#define TASK_GROUP_H_
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include "thread_pool.h"
+
+#define TASK_GROUP_MAX_HELP_DEPTH (16)	//Nested runs of unrelated queued tasks allowed on one waiting thread.
+
+/**
+@class	TaskGroup
+@brief	Fork/join on the thread pool where a waiting thread works instead of blocking.
+						   1.run() keeps the child in the group and queues a proxy task that runs it,
+						     so whoever gets there first, the waiter or a worker, runs the child
+						   2.wait() runs the group's own children first, then other queued tasks,
+						     and only sleeps while every child is already running somewhere
+						   3.running unrelated tasks nests them on the waiter's stack, so that part is
+						     limited to TASK_GROUP_MAX_HELP_DEPTH levels; own children always run,
+						     they nest exactly like a serial recursion would
+						   4.the tasks of the waiter's dequeue batch go back to the queue first
+@return	None
+-----------------HOW TO USE IT
+	int sumRange(void* pvRange)
+	{
+		PRange pstRange = (PRange)pvRange;
+		if (pstRange->uLen < 4096) { ...serial...; return 0; }
+
+		Range stLeft = ..., stRight = ...;
+		TaskGroup instGroup;
+		instGroup.run(sumRange, &stLeft);
+		instGroup.run(sumRange, &stRight);
+		instGroup.wait();		//never parks the worker while stLeft/stRight are unstarted
+		pstRange->ullSum = stLeft.ullSum + stRight.ullSum;
+		return 0;
+	}
+*/
+class TaskGroup
+{
+public:
+	typedef ThreadPool::CallBack_T CallBack_T;
+
+	explicit TaskGroup(ThreadPool* pinstPool = ThreadPool::getInstance());
+	~TaskGroup();		//waits for the children still pending
+
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator= (const TaskGroup&) = delete;
+
+	VOID run(CallBack_T pfnProc, VOID* pvArg);	//run--fork one child, may be called from the children too
+	VOID wait();								//wait--join every child forked so far
+
+	static UINT getHelpDepth();		//getHelpDepth--unrelated tasks the calling thread is nested in
+
+private:
+	typedef struct tagGroupState
+	{
+		std::mutex                   mtxState;
+		std::condition_variable      condState;	//a child was forked or the last one finished
+		std::deque<ThreadPool::Task> qChildren;	//forked, not started
+		UINT                         uPending;	//forked, not finished
+	}GroupState, *PGroupState;
+
+	static bool __runChild(const std::shared_ptr<GroupState>& pState);	//__runChild--false if none is unstarted
+
+	ThreadPool                  *m_pinstPool;
+	std::shared_ptr<GroupState>  m_pState;		//shared with the queued proxies, which may outlive the group
+};
+
+#endif //TASK_GROUP_H_
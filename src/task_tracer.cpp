@@ -0,0 +1,180 @@
+#include "task_tracer.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+namespace {
+/* the ring of the calling thread, remembered per tracer instance */
+typedef struct tagRingCache
+{
+	unsigned long long ullTracerSerial;
+	void              *pvRing;
+}RingCache;
+
+std::atomic<unsigned long long> sg_ullTracerSerial(0);
+thread_local RingCache tl_stRingCache = { 0, nullptr };
+thread_local const char* tl_pcThreadName = nullptr;
+
+void writeJsonString(FILE* pFile, const char* pcText)
+{
+	fputc('"', pFile);
+	for (; *pcText != '\0'; ++pcText) {
+		if (*pcText == '"' || *pcText == '\\') {
+			fputc('\\', pFile);
+		}
+		fputc((unsigned char)*pcText < 0x20 ? ' ' : *pcText, pFile);
+	}
+	fputc('"', pFile);
+}
+}   //anonymous
+
+/**
+Function:	TaskTracer()
+@brief      Constructor of TaskTracer.
+@param[in]  uEventsPerThread:ring size, rounded up to a power of two
+@param[out] None
+@return     None
+*/
+TaskTracer::TaskTracer(size_t uEventsPerThread):
+	m_uRingSize(1),
+	m_ullSerial(sg_ullTracerSerial.fetch_add(1) + 1),
+	m_tpOrigin(std::chrono::steady_clock::now()),
+	m_ullNextTaskId(0)
+{
+	while (m_uRingSize < uEventsPerThread) {
+		m_uRingSize <<= 1;
+	}
+}
+
+TaskTracer::~TaskTracer()
+{
+}
+
+void TaskTracer::setThreadName(const char* pcName)
+{
+	tl_pcThreadName = pcName;
+}
+
+/**
+Function:	record()
+@brief      Append one event to the calling thread's ring. Wait-free, the only shared
+            store is the ring head which no other thread writes.
+@param[in]  eType:enqueue/begin/end, ullTaskId:from nextTaskId(), pcLabel:static string or nullptr
+@param[out] None
+@return     None
+*/
+void TaskTracer::record(TraceType_E eType, unsigned long long ullTaskId, const char* pcLabel)
+{
+	PTraceRing pRing = __threadRing();
+	unsigned long long ullHead = pRing->ullHead.load(std::memory_order_relaxed);
+
+	TraceEvent& stEvent = pRing->pEvents[ullHead & (m_uRingSize - 1)];
+	stEvent.ullTimeNs = (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - m_tpOrigin).count();
+	stEvent.ullTaskId = ullTaskId;
+	stEvent.pcLabel = pcLabel;
+	stEvent.eType = eType;
+
+	pRing->ullHead.store(ullHead + 1, std::memory_order_release);
+}
+
+/**
+Function:	writeChromeTrace()
+@brief      Write every ring as Chrome trace-event JSON. Threads keep recording meanwhile;
+            events overwritten during the copy are dropped rather than written torn.
+@param[in]  pcFileName:output file
+@param[out] None
+@return     false if the file can't be written
+*/
+bool TaskTracer::writeChromeTrace(const char* pcFileName)
+{
+	FILE* pFile = fopen(pcFileName, "w");
+	if (pFile == nullptr) {
+		return false;
+	}
+
+	std::vector<PTraceRing> vecRings;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxRings);
+		for (auto& pRing : m_vecRings) {
+			vecRings.push_back(pRing.get());
+		}
+	}
+
+	fprintf(pFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	bool bFirst = true;
+	std::vector<TraceEvent> vecCopy(m_uRingSize);
+	for (PTraceRing pRing : vecRings) {
+		unsigned long long ullEnd = pRing->ullHead.load(std::memory_order_acquire);
+		unsigned long long ullFirst = ullEnd > m_uRingSize ? ullEnd - m_uRingSize : 0;
+		for (unsigned long long ull = ullFirst; ull < ullEnd; ++ull) {
+			vecCopy[ull - ullFirst] = pRing->pEvents[ull & (m_uRingSize - 1)];
+		}
+		//anything the owner lapped while we copied may be torn
+		unsigned long long ullAfter = pRing->ullHead.load(std::memory_order_acquire);
+		unsigned long long ullValid = ullAfter > m_uRingSize ? ullAfter - m_uRingSize : 0;
+		unsigned long long ullBegin = (std::max)(ullFirst, (std::min)(ullValid, ullEnd));
+
+		fprintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+		        bFirst ? "" : ",\n", pRing->uTrackId);
+		writeJsonString(pFile, pRing->pcThreadName);
+		fprintf(pFile, "}}");
+		bFirst = false;
+
+		for (unsigned long long ull = ullBegin; ull < ullEnd; ++ull) {
+			const TraceEvent& stEvent = vecCopy[ull - ullFirst];
+			double dTimeUs = stEvent.ullTimeNs / 1000.0;
+			const char* pcLabel = stEvent.pcLabel ? stEvent.pcLabel : "task";
+			switch (stEvent.eType) {
+			case TRACE_ENQUEUE:
+				fprintf(pFile, ",\n{\"name\":\"task\",\"cat\":\"task\",\"ph\":\"s\",\"id\":%llu,\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+				        stEvent.ullTaskId, dTimeUs, pRing->uTrackId);
+				fprintf(pFile, ",\n{\"name\":\"enqueue\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"task\":%llu,\"label\":",
+				        dTimeUs, pRing->uTrackId, stEvent.ullTaskId);
+				writeJsonString(pFile, pcLabel);
+				fprintf(pFile, "}}");
+				break;
+			case TRACE_BEGIN:
+				fprintf(pFile, ",\n{\"name\":");
+				writeJsonString(pFile, pcLabel);
+				fprintf(pFile, ",\"cat\":\"task\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"task\":%llu}}",
+				        dTimeUs, pRing->uTrackId, stEvent.ullTaskId);
+				fprintf(pFile, ",\n{\"name\":\"task\",\"cat\":\"task\",\"ph\":\"f\",\"bp\":\"e\",\"id\":%llu,\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+				        stEvent.ullTaskId, dTimeUs, pRing->uTrackId);
+				break;
+			case TRACE_END:
+				fprintf(pFile, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", dTimeUs, pRing->uTrackId);
+				break;
+			}
+		}
+	}
+	fprintf(pFile, "\n]}\n");
+	return 0 == fclose(pFile);
+}
+
+TaskTracer::PTraceRing TaskTracer::__threadRing()
+{
+	if (tl_stRingCache.ullTracerSerial == m_ullSerial) {
+		return (PTraceRing)tl_stRingCache.pvRing;
+	}
+
+	//a thread feeding several tracers in turn keeps one ring in each
+	std::lock_guard<std::mutex> guard(m_mtxRings);
+	tl_stRingCache.ullTracerSerial = m_ullSerial;
+	for (auto& pRing : m_vecRings) {
+		if (pRing->idOwner == std::this_thread::get_id()) {
+			tl_stRingCache.pvRing = pRing.get();
+			return pRing.get();
+		}
+	}
+
+	std::unique_ptr<TraceRing> pRing(new TraceRing());
+	pRing->pEvents.reset(new TraceEvent[m_uRingSize]);
+	pRing->ullHead.store(0, std::memory_order_relaxed);
+	pRing->idOwner = std::this_thread::get_id();
+	pRing->pcThreadName = tl_pcThreadName ? tl_pcThreadName : "thread";
+	pRing->uTrackId = (unsigned int)m_vecRings.size() + 1;
+	tl_stRingCache.pvRing = pRing.get();
+	m_vecRings.push_back(std::move(pRing));
+	return (PTraceRing)tl_stRingCache.pvRing;
+}
@@ -0,0 +1,79 @@
+#ifndef TASK_TRACER_H_
+#define TASK_TRACER_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <thread>
+
+#define TRACE_RING_SIZE (8192)	//Events kept per thread, older ones are overwritten.
+
+/**
+@class	TaskTracer
+@brief	Flight recorder of task timelines, exported as Chrome trace-event JSON
+        (chrome://tracing, ui.perfetto.dev).
+						   1.every thread writes into its own fixed-size ring, no lock and no allocation
+						     after the first event of a thread
+						   2.enqueue -> begin is drawn as a flow arrow, begin/end as a slice on the worker
+						   3.the ring keeps the newest TRACE_RING_SIZE events of each thread
+@return	None
+-----------------HOW TO USE IT
+	ThreadPool::getInstance()->enableTracing();
+	ThreadPool::getInstance()->addTask(fnProc, pvA, "parse");	//label must outlive the tracer, use literals
+	...
+	ThreadPool::getInstance()->dumpTrace("pool.trace.json");
+*/
+class TaskTracer
+{
+public:
+	typedef enum tagTraceType
+	{
+		TRACE_ENQUEUE,
+		TRACE_BEGIN,
+		TRACE_END
+	}TraceType_E;
+
+	explicit TaskTracer(size_t uEventsPerThread = TRACE_RING_SIZE);
+	~TaskTracer();
+
+	TaskTracer(const TaskTracer&) = delete;
+	TaskTracer& operator= (const TaskTracer&) = delete;
+
+	unsigned long long nextTaskId() { return m_ullNextTaskId.fetch_add(1, std::memory_order_relaxed) + 1; }
+	void record(TraceType_E eType, unsigned long long ullTaskId, const char* pcLabel);	//record--append to the calling thread's ring
+	bool writeChromeTrace(const char* pcFileName);		//writeChromeTrace--snapshot all rings into a JSON file
+
+	static void setThreadName(const char* pcName);		//setThreadName--shown as the track name, set before the first event
+
+private:
+	typedef struct tagTraceEvent
+	{
+		unsigned long long ullTimeNs;
+		unsigned long long ullTaskId;
+		const char        *pcLabel;
+		TraceType_E        eType;
+	}TraceEvent, *PTraceEvent;
+
+	typedef struct tagTraceRing
+	{
+		std::unique_ptr<TraceEvent[]>   pEvents;
+		std::atomic<unsigned long long> ullHead;	//events written so far, only the owner thread stores
+		std::thread::id                 idOwner;
+		unsigned int                    uTrackId;
+		const char                     *pcThreadName;
+	}TraceRing, *PTraceRing;
+
+	PTraceRing __threadRing();
+
+	size_t                                  m_uRingSize;	//power of two
+	unsigned long long                      m_ullSerial;	//tells the thread-local ring cache which tracer it belongs to
+	std::chrono::steady_clock::time_point   m_tpOrigin;
+	std::atomic<unsigned long long>         m_ullNextTaskId;
+	std::mutex                              m_mtxRings;
+	std::vector<std::unique_ptr<TraceRing>> m_vecRings;
+};
+
+#endif //TASK_TRACER_H_
@@ -4,111 +4,16 @@
 #include <stdarg.h>
 
 #include <functional>
-//Different definition in linux and WIN32
+#include <algorithm>
+#include <chrono>
 #ifdef __linux__
-/** 
-Function:	cleanup()
-@brief      release the mutex when the thread is stopped
-@param[in]  lock:mutex lock
-@param[out] None
-@return     None    
-*/
-void ThreadPool::cleanup(pthread_mutex_t* lock) {
-	pthread_mutex_unlock(lock);
-}
-/** 
-Function:	tp_thread_worker()
-@brief      Every thread execute this function when working until being destroyed
-@param[in]  None
-@param[out] None
-@return     None    
-*/
-void * ThreadPool::tp_thread_worker() {
-	struct task *t;
-	while (1) {
-		//Triggering Mutex Locks when Preempting qTasks to Prevent Resource Occupation
-		pthread_mutex_lock(&lock);	
-		pthread_cleanup_push((void(*)(void*))cleanup, &lock);
-		//the thread wait until the queue is not empty, wait can release the CPU resource
-		while (qTasks->queue_IsEmpty()) {
-			pthread_cond_wait(&task_ready, &lock);
-			/*A condition wait is a cancellation point 
-			a side-effect of acting upon a cancellation request 
-			while in a condition wait is that the mutex is (in effect) re-acquired 
-			before calling the first cancellation cleanup handler.*/
-		}
-		t = (struct task*)qTasks->queue_Dequeue();
-		pthread_cleanup_pop(0);
-		pthread_mutex_unlock(&lock);
-		t->routine(t->arg);			//Deal with the task
-		free(t);					//Free the pointer after finish the work
-	}
-	return NULL;
-}
-/** 
-Function:	ThreadPool()
-@brief      Constructor of ThreadPool. Initialize the member variables.
-            Create a threadpool that contais severial thread
-@param[in]  thread_count:the number of threads that needed to be created in advance
-@param[out] None
-@return     None    
-*/
-ThreadPool::ThreadPool(unsigned int m_thread_count) {
-	unsigned int i;
-	m_thread_count = m_thread_count;
-	threads = (pthread_t*)malloc(sizeof(pthread_t)*m_thread_count);
-
-	qTasks = new CQueue();
-
-	pthread_mutex_init(&lock, NULL);
-	pthread_cond_init(&task_ready, NULL);
-
-	for (i = 0; i<m_thread_count; i++) {
-		//create threads and link the thread to worker function tp_thread_worker()
-		pthread_create(threads + i, NULL, (void*(*)(void*))tp_thread_worker, this);
-	}
-}
-/** 
-Function:	addTask()
-@brief      Add qTasks to the queue and wait to be dealt with. 
-@param[in]  routine:the qTasks work in the function, arg:index of qTasks
-@param[out] None
-@return     None    
-*/
-void ThreadPool::addTask(void* (*routine)(void *arg), void *arg) {
-	struct task *t;
-	//Use mutex lock to ensure only one thread can be notified
-	pthread_mutex_lock(&lock);
-	t = (struct task*)qTasks->queue_Enqueue(sizeof(struct task));
-	t->routine = routine;
-	t->arg = arg;
-	pthread_cond_signal(&task_ready);
-	pthread_mutex_unlock(&lock);
-}
+#include <limits.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+//Only starting and joining the threads differ between linux and WIN32
 
-/** 
-Function:	~ThreadPool()
-@brief      Destructor of ThreadPool.
-@param[in]  None
-@param[out] None
-@return     None 
-*/
-ThreadPool::~ThreadPool() {
-	unsigned int i;
-	for (i = 0; i < m_thread_count; i++) {
-		//destroy the threads
-		pthread_cancel(threads[i]);
-	}
-	for (i = 0; i < m_thread_count; i++) {
-		//thread wait other threads before being destroyed
-		pthread_join(threads[i], NULL);
-	}
-	pthread_mutex_destroy(&lock);
-	pthread_cond_destroy(&task_ready);
-	qTasks->~CQueue();
-	free(threads);
-}
-#elif _WIN32
 
 /** 
 Function:	ThreadPool()
@@ -118,13 +23,29 @@ Function:	ThreadPool()
 @return     None    b
 */
 ThreadPool::ThreadPool() :
-	m_dwThreadId(NULL),
+	m_dwThreadId(0),
+	m_uThreadCount(MAX_THREADS),
 	m_iTaskNum(0),
-	m_bStoped(false)
+	m_bStoped(false),
+	m_iIdleWorkers(0),
+	m_uMaxBatch(MAX_BATCH_TASKS),
+	m_ullDequeueLocks(0),
+	m_ullTasksRun(0),
+	m_uStartedWorkers(0),
+	m_uAttrFailures(0),
+	m_uActiveLimit(MAX_THREADS),
+	m_ullBusyNs(0),
+	m_pinstEpoch(nullptr),
+	m_bTunerStop(false),
+	m_pinstTracer(nullptr)
+#ifdef __linux__
+	,m_pinstReactorLive(nullptr),
+	m_bReactorDriven(false)
+#endif
 {
-	m_pThreadHandleTbl = new std::vector<HANDLE>(MAX_THREADS);
-	//create threads and link the thread to worker function __threadWorker
-	__runWorker(&ThreadPool::__threadWorker);
+	//workers are started by addTask() or prewarm(), see __runWorker
+	m_pThreadHandleTbl = new std::vector<HANDLE>();
+	m_pThreadHandleTbl->reserve(m_uThreadCount);
 }
 /** 
 Function:	ThreadPool()
@@ -134,15 +55,33 @@ Function:	ThreadPool()
 @return     None    b  
 */
 ThreadPool::ThreadPool(UINT uThreadCount):
-	m_dwThreadId(NULL),
+	m_dwThreadId(0),
+	m_uThreadCount(uThreadCount),
 	m_iTaskNum(0),
-	m_bStoped(false)
+	m_bStoped(false),
+	m_iIdleWorkers(0),
+	m_uMaxBatch(MAX_BATCH_TASKS),
+	m_ullDequeueLocks(0),
+	m_ullTasksRun(0),
+	m_uStartedWorkers(0),
+	m_uAttrFailures(0),
+	m_uActiveLimit(uThreadCount),
+	m_ullBusyNs(0),
+	m_pinstEpoch(nullptr),
+	m_bTunerStop(false),
+	m_pinstTracer(nullptr)
+#ifdef __linux__
+	,m_pinstReactorLive(nullptr),
+	m_bReactorDriven(false)
+#endif
 {
-	m_pThreadHandleTbl = new std::vector<HANDLE>(uThreadCount);
-	DP("createPool and create thread\n");
-	//create threads and link the thread to worker function __threadWorker
-	__runWorker(&ThreadPool::__threadWorker);
+	DP("createPool, threads are created on demand\n");
+	m_pThreadHandleTbl = new std::vector<HANDLE>();
+	m_pThreadHandleTbl->reserve(m_uThreadCount);
 }
+static thread_local ThreadPool* tl_pinstBatchOwner = nullptr;				//pool of the worker running on this thread
+static thread_local ThreadPool::PWorkerBatch tl_pstWorkerBatch = nullptr;	//tasks that worker took but hasn't run
+
 /** 
 Function:	__threadWorker()
 @brief      Every thread execute this function when working until being destroyed
@@ -151,58 +90,278 @@ Function:	__threadWorker()
 @return     None    
 */
 DWORD ThreadPool::__threadWorker(LPVOID pvParam) {
-	PTask pTmpTask;
+	WorkerBatch stBatch;
+	ScratchArena* pinstArena = __attachScratchArena();
+	UINT uIndex;
+	tl_pinstBatchOwner = this;
+	tl_pstWorkerBatch = &stBatch;
+	{
+		std::lock_guard<std::mutex> guard(this->m_mtxTask);
+		uIndex = this->m_uStartedWorkers++;
+		__applyThreadAttr(uIndex);
+	}
+	this->m_condWorkerStarted.notify_all();
 	while (!this->m_bStoped.load()) {
 
 		std::unique_lock<std::mutex> uLocker(this->m_mtxTask);
-		this->m_condTaskReady.wait(uLocker, [this] { return (this->m_bStoped.load() ||
-															 !this->m_qTasks.empty()); });
+		if (uIndex >= this->m_uActiveLimit) {
+			//parked by the tuner, apart from the idle ones so addTask's notify_one never lands here
+			this->m_condWorkerParked.wait(uLocker, [this, uIndex] { return this->m_bStoped.load() ||
+																		  uIndex < this->m_uActiveLimit; });
+			continue;
+		}
+#ifdef __linux__
+		if (__driveReactor(uLocker)) {
+			continue;
+		}
+#endif
+		//nothing to run: free retired nodes before going to sleep, outside the lock
+		EpochDomain* pinstEpoch = this->m_pinstEpoch.load(std::memory_order_relaxed);
+		if (pinstEpoch != nullptr && !this->m_qTasks.hasRunnable() && !this->m_bStoped.load()) {
+			uLocker.unlock();
+			pinstEpoch->reclaim();
+			uLocker.lock();
+		}
+		this->m_iIdleWorkers++;
+		this->m_condTaskReady.wait(uLocker, [this] { return ((this->m_bStoped.load() && this->m_qTasks.size() == 0) ||
+															 this->m_qTasks.hasRunnable() ||
+															 this->__reactorUndriven()); });
+		this->m_iIdleWorkers--;
 
-		if (this->m_bStoped.load() && this->m_qTasks.empty()) {
+		if (this->m_bStoped.load() && this->m_qTasks.size() == 0) {
 			return 0;
 		}
+		if (!this->m_qTasks.hasRunnable()) {
+			continue;	//woken to drive the reactor
+		}
 
-		pTmpTask = this->m_qTasks.front();
-		this->m_qTasks.pop();
+		//one lock acquisition takes a share of the queue, idle peers keep theirs
+		UINT uTake = __batchSize();
+		unsigned long long ullNowNs = FairTaskQueue::nowNs();
+		for (stBatch.uHead = 0, stBatch.uCount = 0; stBatch.uCount < uTake; ++stBatch.uCount) {
+			FairTaskQueue::PTenant pstTenant;
+			PTask pTask = (PTask)this->m_qTasks.popNext(&pstTenant, ullNowNs);
+			if (pTask == nullptr) {
+				break;		//the rest belongs to capped tenants
+			}
+			stBatch.apTasks[stBatch.uCount] = pTask;
+		}
+		this->m_ullDequeueLocks++;
 		uLocker.unlock();
 
-		ULONGLONG Start = GetTickCount64();
-		pTmpTask->pfnProc(pTmpTask->pvArg);
-		ULONGLONG End = GetTickCount64();
+		while (stBatch.uHead < stBatch.uCount) {
+			__runTask(stBatch.apTasks[stBatch.uHead++], pinstArena);
 
-		//some test print to ensure the thread pool work well
-		DP("Finish time of task %d running in thread %d is %d\n ", (int)pTmpTask->pvArg, GetCurrentThreadId(), (int)(End - Start));
-		DP("---Thread %d returns to wait.---\n", GetCurrentThreadId());
-		DP("the number of left qTasks wait in the queue is %d\n", this->m_qTasks.size());
-		this->m_iTaskNum--;
-
-		delete pTmpTask;
+			//peers went idle while we sit on tasks: hand the rest back
+			if (stBatch.uHead < stBatch.uCount && this->m_iIdleWorkers.load(std::memory_order_relaxed) > 0) {
+				releaseBatch();
+			}
+		}
 	}
 	return 0;
 }
 
-/** 
+/** 
+Function:	__runTask()
+@brief      Run one task on the calling worker, then drop its scratch memory
+@param[in]  pTmpTask:task taken from the queue, deleted here
+@param[in]  pinstArena:scratch arena of the calling worker, nullptr for a nested run that must keep it
+@param[out] None
+@return     None    
+*/
+VOID ThreadPool::__runTask(PTask pTmpTask, ScratchArena* pinstArena)
+{
+	TaskTracer* pinstTracer = this->m_pinstTracer.load(std::memory_order_relaxed);
+	if (pinstTracer != nullptr) {
+		pinstTracer->record(TaskTracer::TRACE_BEGIN, pTmpTask->ullTraceId, pTmpTask->pcLabel);
+	}
+	auto Start = std::chrono::steady_clock::now();
+	pTmpTask->pfnProc(pTmpTask->pvArg);
+	auto End = std::chrono::steady_clock::now();
+	if (pinstTracer != nullptr) {
+		pinstTracer->record(TaskTracer::TRACE_END, pTmpTask->ullTraceId, pTmpTask->pcLabel);
+	}
+
+	//some test print to ensure the thread pool work well
+	DP("Finish time of task %d running in thread %d is %d\n ", (int)pTmpTask->pvArg, GetCurrentThreadId(), (int)std::chrono::duration_cast<std::chrono::milliseconds>(End - Start).count());
+	DP("---Thread %d returns to wait.---\n", GetCurrentThreadId());
+	DP("the number of left qTasks wait in the queue is %d\n", this->m_qTasks.size());
+	this->m_iTaskNum--;
+	this->m_ullTasksRun++;
+	this->m_ullBusyNs += (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(End - Start).count();
+
+	//a capped tenant's finished task may make its queued ones runnable
+	if (this->m_qTasks.finish(pTmpTask->pstTenant)) {
+		std::lock_guard<std::mutex> guard(this->m_mtxTask);
+		this->m_condTaskReady.notify_one();
+	}
+	delete pTmpTask;
+	if (pinstArena != nullptr) {
+		pinstArena->reset();
+	}
+}
+
+/** 
+Function:	runPendingTask()
+@brief      Run the oldest queued task on the calling thread, for a thread that would otherwise
+            block waiting on other tasks (see TaskGroup::wait). The caller's scratch memory is kept.
+@param[in]  None
+@param[out] None
+@return     false if the queue was empty    
+*/
+bool ThreadPool::runPendingTask()
+{
+	PTask pTmpTask;
+	{
+		std::lock_guard<std::mutex> guard(m_mtxTask);
+		FairTaskQueue::PTenant pstTenant;
+		pTmpTask = (PTask)m_qTasks.popNext(&pstTenant, FairTaskQueue::nowNs());
+		if (pTmpTask == nullptr) {
+			return false;
+		}
+	}
+	__runTask(pTmpTask, nullptr);
+	return true;
+}
+
+/** 
+Function:	__batchSize()
+@brief      How many tasks one dequeue takes: the queue split evenly between this worker and the idle ones,
+            capped by setMaxBatch(). Called with m_mtxTask held and the queue not empty.
+@param[in]  None
+@param[out] None
+@return     1..m_uMaxBatch    
+*/
+UINT ThreadPool::__batchSize()
+{
+	size_t uShare = this->m_qTasks.size() / (size_t)(this->m_iIdleWorkers.load(std::memory_order_relaxed) + 1);
+	UINT uMaxBatch = this->m_uMaxBatch.load(std::memory_order_relaxed);
+	if (uShare < 1) {
+		return 1;
+	}
+	return uShare < uMaxBatch ? (UINT)uShare : uMaxBatch;
+}
+
+/** 
 Function:	__runWorker()
-@brief      run memberFunction and create thread
-@param[in]  pfnMemberProc
-@param[out] None
-@return     None    
+@brief      Create one more worker thread running pfnMemberProc. Called with m_mtxTask held,
+            by addTask() when the queue outgrows the idle workers and by prewarm().
+@param[in]  pfnMemberProc
+@param[out] None
+@return     false if the thread can't be created    
 */
 DWORD ThreadPool::__runWorker(MEMBER_PROC_FUNC pfnMemberProc)
 {
-	/* Entry is guaranteed and no checks needs made */
+	HANDLE hThread;
 
 	m_unProc.pfnMemberProc = pfnMemberProc;
-	for (UINT uIndex = 0; uIndex < m_pThreadHandleTbl->size(); ++uIndex) {
+#ifdef __linux__
+	pthread_attr_t stAttr;
+	pthread_attr_init(&stAttr);
+	if (m_stThreadAttr.uStackSize != 0) {
+		size_t uPage = (size_t)sysconf(_SC_PAGESIZE);
+		size_t uStack = (std::max)(m_stThreadAttr.uStackSize, (size_t)PTHREAD_STACK_MIN);
+		uStack = (uStack + uPage - 1) / uPage * uPage;
+		if (pthread_attr_setstacksize(&stAttr, uStack) != 0) {
+			m_uAttrFailures |= THREAD_ATTR_STACK_FAILED;
+		}
+	}
+	int iRet = pthread_create(&hThread, &stAttr, __linuxThreadEntry, (LPVOID)this);
+	pthread_attr_destroy(&stAttr);
+	if (iRet != 0) {
+		return false;
+	}
+#elif _WIN32
+	//a reservation, the default commit stays; 0 takes the size from the exe header
+	hThread = CreateThread(nullptr, m_stThreadAttr.uStackSize, LPTHREAD_START_ROUTINE(m_unProc.pfnThreadProc),
+		                   (LPVOID)this, m_stThreadAttr.uStackSize != 0 ? STACK_SIZE_PARAM_IS_A_RESERVATION : 0,
+		                   &m_dwThreadId);
+	if (hThread == NULL) {
+		return false;
+	}
+#endif
+	m_pThreadHandleTbl->push_back(hThread);
 
-		m_pThreadHandleTbl->at(uIndex) = CreateThread(nullptr, 0, LPTHREAD_START_ROUTINE(m_unProc.pfnThreadProc),
-			                                         (LPVOID)this, 0, &m_dwThreadId);
+	DP("creat thread id: %d \n", m_dwThreadId);
+	return true;
+}
 
-		DP("creat thread id: %d \n", m_dwThreadId);
+/** 
+Function:	__applyThreadAttr()
+@brief      Name and schedule the calling worker after m_stThreadAttr. Every step that the OS
+            refuses, usually for lack of privilege, is recorded in m_uAttrFailures and skipped.
+@param[in]  uIndex:number of the worker, for its name
+@param[out] None
+@return     None    
+*/
+VOID ThreadPool::__applyThreadAttr(UINT uIndex)
+{
+	const ThreadAttr& stAttr = m_stThreadAttr;
+	TaskTracer::setThreadName(stAttr.pcName != nullptr ? stAttr.pcName : "worker");
+#ifdef __linux__
+	if (stAttr.pcName != nullptr) {
+		char acName[16];	//the kernel keeps 15 characters
+		snprintf(acName, sizeof(acName), "%s-%u", stAttr.pcName, uIndex);
+		if (pthread_setname_np(pthread_self(), acName) != 0) {
+			m_uAttrFailures |= THREAD_ATTR_NAME_FAILED;
+		}
+	}
+	//nice is per thread on linux, a negative one needs CAP_SYS_NICE
+	if (stAttr.iNice != 0 && setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), stAttr.iNice) != 0) {
+		m_uAttrFailures |= THREAD_ATTR_NICE_FAILED;
+	}
+	if (stAttr.eSched != THREAD_SCHED_NORMAL) {
+		struct sched_param stParam;
+		stParam.sched_priority = stAttr.iRtPriority;
+		int iPolicy = stAttr.eSched == THREAD_SCHED_FIFO ? SCHED_FIFO : SCHED_RR;
+		if (pthread_setschedparam(pthread_self(), iPolicy, &stParam) != 0) {
+			m_uAttrFailures |= THREAD_ATTR_SCHED_FAILED;
+		}
+	}
+#elif _WIN32
+	if (stAttr.pcName != nullptr) {
+		char acName[64];
+		wchar_t awcName[64];
+		int iLen = snprintf(acName, sizeof(acName), "%s-%u", stAttr.pcName, uIndex);
+		for (int i = 0; i <= iLen && i < 64; ++i) {
+			awcName[i] = (wchar_t)(unsigned char)acName[i];
+		}
+		awcName[63] = L'\0';
+		if (FAILED(SetThreadDescription(GetCurrentThread(), awcName))) {
+			m_uAttrFailures |= THREAD_ATTR_NAME_FAILED;
+		}
+	}
+	int iPriority = THREAD_PRIORITY_NORMAL;
+	if (stAttr.eSched != THREAD_SCHED_NORMAL) {
+		iPriority = THREAD_PRIORITY_TIME_CRITICAL;
+	}
+	else if (stAttr.iNice != 0) {
+		iPriority = stAttr.iNice <= -10 ? THREAD_PRIORITY_HIGHEST :
+		            stAttr.iNice < 0 ? THREAD_PRIORITY_ABOVE_NORMAL :
+		            stAttr.iNice < 10 ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_LOWEST;
 	}
+	if (iPriority != THREAD_PRIORITY_NORMAL && !SetThreadPriority(GetCurrentThread(), iPriority)) {
+		m_uAttrFailures |= stAttr.eSched != THREAD_SCHED_NORMAL ? THREAD_ATTR_SCHED_FAILED : THREAD_ATTR_NICE_FAILED;
+	}
+#endif
+}
 
-	return true;
+#ifdef __linux__
+/** 
+Function:	__linuxThreadEntry()
+@brief      pthread start routine, pthread has no member-function entry like the WIN32 union trick
+@param[in]  pvThis:the pool
+@param[out] None
+@return     NULL    
+*/
+void* ThreadPool::__linuxThreadEntry(void* pvThis)
+{
+	ThreadPool* pinstPool = (ThreadPool*)pvThis;
+	MEMBER_PROC_FUNC pfnMemberProc = pinstPool->m_unProc.pfnMemberProc;
+	(pinstPool->*pfnMemberProc)(nullptr);
+	return NULL;
 }
+#endif
 
 /** 
 Function:	addTask()
@@ -212,15 +371,50 @@ Function:	addTask()
 @return     None    
 
 */
-VOID ThreadPool::addTask(CallBack_T pfnProcess, VOID *pvArgInput)
+VOID ThreadPool::addTask(CallBack_T pfnProcess, VOID *pvArgInput, const char* pcLabel)
+{
+	addTask(FAIR_QUEUE_DEFAULT_TENANT, pfnProcess, pvArgInput, pcLabel);
+}
+
+/** 
+Function:	addTask()
+@brief      Add a task to the queue of a tenant. Workers take tasks from the tenants'
+            queues by weighted deficit round robin, see setTenant().
+@param[in]  uTenant:tenant id, created with weight 1 on first use
+@param[in]  pfnProcess/pvArgInput/pcLabel:as addTask() above
+@param[out] None
+@return     None    
+*/
+VOID ThreadPool::addTask(UINT uTenant, CallBack_T pfnProcess, VOID *pvArgInput, const char* pcLabel)
 {
 	m_iTaskNum++;
 
-	PTask pTmp = new Task(pfnProcess, pvArgInput);
+	PTask pTmp = new Task(pfnProcess, pvArgInput, pcLabel);
+	TaskTracer* pinstTracer = m_pinstTracer.load(std::memory_order_relaxed);
+	if (pinstTracer != nullptr) {
+		pTmp->ullTraceId = pinstTracer->nextTaskId();
+		pinstTracer->record(TaskTracer::TRACE_ENQUEUE, pTmp->ullTraceId, pcLabel);
+	}
 	//Use mutex lock to ensure only one thread can be notified
+	unsigned long long ullNowNs = FairTaskQueue::nowNs();
 	m_mtxTask.lock();
-	m_qTasks.emplace(pTmp);
+	pTmp->pstTenant = m_qTasks.tenant(uTenant);
+	m_qTasks.pushBack(pTmp->pstTenant, pTmp, ullNowNs);
     m_condTaskReady.notify_one();
+	//start another worker only when the queue outgrows the ones that will pick it up
+	size_t uAvailable = (size_t)m_iIdleWorkers.load(std::memory_order_relaxed);
+#ifdef __linux__
+	uAvailable += m_bReactorDriven ? 1 : 0;
+#endif
+	if (m_qTasks.size() > uAvailable && m_pThreadHandleTbl->size() < m_uActiveLimit) {
+		__runWorker(&ThreadPool::__threadWorker);
+	}
+#ifdef __linux__
+	//nobody sleeps on the condition variable, the worker polling the reactor has to take it
+	if (m_bReactorDriven && m_iIdleWorkers.load(std::memory_order_relaxed) == 0) {
+		m_pinstReactorLive.load(std::memory_order_relaxed)->wake();
+	}
+#endif
 	m_mtxTask.unlock();
 }
 
@@ -235,15 +429,442 @@ ThreadPool::~ThreadPool() {
 	DP("Destroying...wait...\n");
 	unsigned int i;
 
-	m_bStoped.store(true);
+	disableAutoTune();
+
+#ifdef __linux__
+	//no IO callback may be queued once the workers start leaving
+	if (m_pinstReactor) {
+		m_pinstReactor->stop();
+	}
+#endif
+	{
+		//under the lock, a worker between its predicate check and its wait would miss the notify
+		std::lock_guard<std::mutex> guard(m_mtxTask);
+		m_bStoped.store(true);
+	}
 	m_condTaskReady.notify_all();
+	m_condWorkerParked.notify_all();
+#ifdef __linux__
+	if (m_pinstReactor) {
+		m_pinstReactor->wake();	//the worker polling in REACTOR_IDLE_WORKER mode
+	}
+#endif
 
+#ifdef __linux__
+	for (i = 0; i < m_pThreadHandleTbl->size(); i++) {
+		pthread_join(m_pThreadHandleTbl->at(i), NULL);
+	}
+#elif _WIN32
+	for (i = 0; i < m_pThreadHandleTbl->size(); i++) {
+		WaitForSingleObject(m_pThreadHandleTbl->at(i), INFINITE);
+	}
 	for (i = 0; i < m_pThreadHandleTbl->size(); i++) {
-        if (i > 0) {
-            WaitForSingleObject(m_pThreadHandleTbl->at(i - 1), INFINITE);
-        }
 		CloseHandle(m_pThreadHandleTbl->at(i));
 	}
+#endif
 	delete m_pThreadHandleTbl;
+#ifdef __linux__
+	m_pinstReactor.reset();
+#endif
+}
+
+static thread_local ScratchArena* tl_pinstScratchArena = nullptr;	//arena of the worker running on this thread
+
+/** 
+Function:	__attachScratchArena()
+@brief      Create the scratch arena of the calling worker and publish it through the thread-local accessor
+@param[in]  None
+@param[out] None
+@return     the arena, owned by the pool    
+*/
+ScratchArena* ThreadPool::__attachScratchArena()
+{
+	std::unique_ptr<ScratchArena> pinstArena(new ScratchArena());
+	tl_pinstScratchArena = pinstArena.get();
+
+	std::lock_guard<std::mutex> guard(m_mtxScratch);
+	m_vecScratchArenas.push_back(std::move(pinstArena));
+	return tl_pinstScratchArena;
+}
+
+ScratchArena* ThreadPool::getScratchArena()
+{
+	return tl_pinstScratchArena;
+}
+
+std::pmr::memory_resource* ThreadPool::getScratchResource()
+{
+	if (tl_pinstScratchArena != nullptr) {
+		return tl_pinstScratchArena;
+	}
+	return std::pmr::new_delete_resource();
+}
+
+/** 
+Function:	getScratchStats()
+@brief      Sum the scratch arena statistics of all workers
+@param[in]  None
+@param[out] None
+@return     uCapacity/ullChunkAllocs/ullResets are totals, uHighWater is the largest of any worker    
+*/
+ScratchArena::ScratchStats ThreadPool::getScratchStats()
+{
+	ScratchArena::ScratchStats stTotal = { 0, 0, 0, 0 };
+
+	std::lock_guard<std::mutex> guard(m_mtxScratch);
+	for (auto& pinstArena : m_vecScratchArenas) {
+		ScratchArena::ScratchStats stOne = pinstArena->getStats();
+		stTotal.uHighWater = (std::max)(stTotal.uHighWater, stOne.uHighWater);
+		stTotal.uCapacity += stOne.uCapacity;
+		stTotal.ullChunkAllocs += stOne.ullChunkAllocs;
+		stTotal.ullResets += stOne.ullResets;
+	}
+	return stTotal;
+}
+
+/** 
+Function:	enableTracing()
+@brief      Start recording task events. The tracer is created once and kept for the pool's lifetime,
+            so disabling and enabling again keeps appending to the same rings.
+@param[in]  uEventsPerThread:ring size of every thread, only used the first time
+@param[out] None
+@return     None    
+*/
+VOID ThreadPool::enableTracing(size_t uEventsPerThread)
+{
+	std::lock_guard<std::mutex> guard(m_mtxTracer);
+	if (!m_pinstTracerStore) {
+		m_pinstTracerStore.reset(new TaskTracer(uEventsPerThread));
+	}
+	m_pinstTracer.store(m_pinstTracerStore.get());
+}
+
+VOID ThreadPool::disableTracing()
+{
+	m_pinstTracer.store(nullptr);
+}
+
+bool ThreadPool::dumpTrace(const char* pcFileName)
+{
+	std::lock_guard<std::mutex> guard(m_mtxTracer);
+	return m_pinstTracerStore && m_pinstTracerStore->writeChromeTrace(pcFileName);
+}
+
+/** 
+Function:	releaseBatch()
+@brief      Put the tasks the calling worker took but hasn't started back at the head of the queue.
+            Call it from a task before it blocks, so those tasks don't wait behind it.
+@param[in]  None
+@param[out] None
+@return     None    
+*/
+VOID ThreadPool::releaseBatch()
+{
+	ThreadPool* pinstPool = tl_pinstBatchOwner;
+	PWorkerBatch pstBatch = tl_pstWorkerBatch;
+	if (pinstPool == nullptr || pstBatch->uHead == pstBatch->uCount) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(pinstPool->m_mtxTask);
+	unsigned long long ullNowNs = FairTaskQueue::nowNs();
+	while (pstBatch->uCount > pstBatch->uHead) {
+		PTask pTask = pstBatch->apTasks[--pstBatch->uCount];
+		pinstPool->m_qTasks.pushFront(pTask->pstTenant, pTask, ullNowNs);
+		pinstPool->m_condTaskReady.notify_one();
+	}
+}
+
+VOID ThreadPool::setMaxBatch(UINT uMaxBatch)
+{
+	if (uMaxBatch < 1) {
+		uMaxBatch = 1;
+	}
+	m_uMaxBatch.store(uMaxBatch < MAX_BATCH_TASKS ? uMaxBatch : MAX_BATCH_TASKS);
+}
+
+ThreadPool::DequeueStats ThreadPool::getDequeueStats()
+{
+	std::lock_guard<std::mutex> guard(m_mtxTask);
+	DequeueStats stStats;
+	stStats.ullLockAcquisitions = m_ullDequeueLocks;
+	stStats.ullTasks = m_ullTasksRun.load();
+	return stStats;
+}
+
+/** 
+Function:	__reactorUndriven()
+@brief      True when an idle worker should be polling the reactor and none is. Called with m_mtxTask held.
+@param[in]  None
+@param[out] None
+@return     always false on WIN32    
+*/
+bool ThreadPool::__reactorUndriven()
+{
+#ifdef __linux__
+	return m_pinstReactor && m_pinstReactor->getMode() == Reactor::REACTOR_IDLE_WORKER &&
+		!m_bReactorDriven && !m_bStoped.load() && !m_qTasks.hasRunnable();
+#else
+	return false;
+#endif
+}
+
+#ifdef __linux__
+/** 
+Function:	startReactor()
+@brief      Create the epoll reactor. REACTOR_THREAD gives it its own thread; REACTOR_IDLE_WORKER lets
+            whichever worker runs out of tasks block in epoll_wait instead of on the condition variable.
+@param[in]  eMode:who drives the reactor
+@param[out] None
+@return     false if already started or epoll is unavailable    
+*/
+bool ThreadPool::startReactor(Reactor::DriveMode_E eMode)
+{
+	std::lock_guard<std::mutex> guard(m_mtxTask);
+	if (m_pinstReactor) {
+		return false;
+	}
+	std::unique_ptr<Reactor> pinstReactor(new Reactor(this, eMode));
+	if (!pinstReactor->start()) {
+		return false;
+	}
+	m_pinstReactor = std::move(pinstReactor);
+	m_pinstReactorLive.store(m_pinstReactor.get());
+	if (eMode == Reactor::REACTOR_IDLE_WORKER && m_pThreadHandleTbl->empty()) {
+		__runWorker(&ThreadPool::__threadWorker);
+	}
+	//an idle worker has to notice it has a reactor to drive now
+	m_condTaskReady.notify_one();
+	return true;
+}
+
+bool ThreadPool::addTaskOnReadable(int iFd, CallBack_T pfnProcess, VOID* pvArgInput)
+{
+	Reactor* pinstReactor = m_pinstReactorLive.load();
+	return pinstReactor != nullptr && pinstReactor->waitReadable(iFd, pfnProcess, pvArgInput);
+}
+
+bool ThreadPool::addTaskOnWritable(int iFd, CallBack_T pfnProcess, VOID* pvArgInput)
+{
+	Reactor* pinstReactor = m_pinstReactorLive.load();
+	return pinstReactor != nullptr && pinstReactor->waitWritable(iFd, pfnProcess, pvArgInput);
+}
+
+int ThreadPool::addTaskAfter(UINT uMs, CallBack_T pfnProcess, VOID* pvArgInput)
+{
+	Reactor* pinstReactor = m_pinstReactorLive.load();
+	return pinstReactor != nullptr ? pinstReactor->waitTimeout(uMs, pfnProcess, pvArgInput) : -1;
+}
+
+UINT ThreadPool::cancelWait(int iFd)
+{
+	Reactor* pinstReactor = m_pinstReactorLive.load();
+	return pinstReactor != nullptr ? pinstReactor->cancel(iFd) : 0;
+}
+
+/** 
+Function:	__driveReactor()
+@brief      In REACTOR_IDLE_WORKER mode, a worker finding the queue empty polls the reactor while nobody
+            else does. addTask() wakes it through the reactor's eventfd when no other worker is asleep.
+@param[in]  uLocker:holds m_mtxTask, released while polling and held again on return
+@param[out] None
+@return     true if it polled, the caller then looks at the queue again    
+*/
+bool ThreadPool::__driveReactor(std::unique_lock<std::mutex>& uLocker)
+{
+	if (!__reactorUndriven()) {
+		return false;
+	}
+
+	m_bReactorDriven = true;
+	uLocker.unlock();
+	m_pinstReactor->poll(-1);
+	uLocker.lock();
+	m_bReactorDriven = false;
+	//hand the reactor to a sleeping peer in case this worker leaves with tasks
+	if (m_iIdleWorkers.load() > 0) {
+		m_condTaskReady.notify_one();
+	}
+	return true;
 }
 #endif
+
+/** 
+Function:	prewarm()
+@brief      Start workers now instead of on the first tasks, and wait until each one has its
+            thread, stack, scratch arena and thread-locals set up. For services whose first
+            requests must not pay for thread creation.
+@param[in]  uCount:workers wanted, capped by the pool size
+@param[out] None
+@return     number of workers running    
+*/
+UINT ThreadPool::prewarm(UINT uCount)
+{
+	std::unique_lock<std::mutex> uLocker(m_mtxTask);
+	uCount = (std::min)(uCount, m_uThreadCount);
+	while (m_pThreadHandleTbl->size() < uCount && __runWorker(&ThreadPool::__threadWorker)) {
+	}
+
+	UINT uSpawned = (UINT)m_pThreadHandleTbl->size();
+	m_condWorkerStarted.wait(uLocker, [this, uSpawned] { return m_uStartedWorkers >= uSpawned; });
+	return uSpawned;
+}
+
+UINT ThreadPool::getWorkerCount()
+{
+	std::lock_guard<std::mutex> guard(m_mtxTask);
+	return (UINT)m_pThreadHandleTbl->size();
+}
+
+/** 
+Function:	setTenant()
+@brief      Configure a tenant's share: per round of the scheduler it gets uWeight tasks started
+            for every one of a weight-1 tenant, and never more than uMaxRunning at once.
+@param[in]  uTenant:tenant id, uWeight:share >= 1, uMaxRunning:concurrency cap, 0 for none
+@param[out] None
+@return     None    
+*/
+VOID ThreadPool::setTenant(UINT uTenant, UINT uWeight, UINT uMaxRunning)
+{
+	std::lock_guard<std::mutex> guard(m_mtxTask);
+	m_qTasks.setTenant(uTenant, uWeight, uMaxRunning);
+	m_condTaskReady.notify_all();	//a raised cap may make queued tasks runnable
+}
+
+FairTaskQueue::TenantStats ThreadPool::getTenantStats(UINT uTenant)
+{
+	std::lock_guard<std::mutex> guard(m_mtxTask);
+	return m_qTasks.getStats(uTenant);
+}
+
+VOID ThreadPool::setThreadAttr(const ThreadAttr& stAttr)
+{
+	std::lock_guard<std::mutex> guard(m_mtxTask);
+	m_stThreadAttr = stAttr;
+}
+
+UINT ThreadPool::getThreadAttrFailures()
+{
+	return m_uAttrFailures.load();
+}
+
+/** 
+Function:	enableAutoTune()
+@brief      Start the controller thread. Every stConfig.uIntervalMs it reads tasks run, busy time
+            and queue depth, asks the AutoTuner for a worker count and parks or wakes workers to
+            match; parked workers keep their threads, only the lazy start is capped.
+@param[in]  stConfig:bounds and timing, uMaxWorkers is clamped to the pool size
+@param[out] None
+@return     false if the tuner is already running    
+*/
+bool ThreadPool::enableAutoTune(const AutoTuner::TuneConfig& stConfig)
+{
+	std::lock_guard<std::mutex> guardTuner(m_mtxTuner);
+	if (m_pinstTuner) {
+		return false;
+	}
+	AutoTuner::TuneConfig stClamped = stConfig;
+	stClamped.uMaxWorkers = (std::min)(stConfig.uMaxWorkers, m_uThreadCount);
+	stClamped.uMinWorkers = (std::min)(stConfig.uMinWorkers, stClamped.uMaxWorkers);
+	stClamped.uIntervalMs = (std::max)(stConfig.uIntervalMs, 1u);
+	{
+		std::lock_guard<std::mutex> guard(m_mtxTask);
+		UINT uStart = (std::max)((UINT)m_pThreadHandleTbl->size(), stClamped.uMinWorkers);
+		m_pinstTuner.reset(new AutoTuner(stClamped, uStart));
+		__setActiveWorkerLimit(m_pinstTuner->getWorkers());
+	}
+	m_bTunerStop = false;
+	m_thrTuner = std::thread(&ThreadPool::__autoTuneLoop, this);
+	return true;
+}
+
+VOID ThreadPool::disableAutoTune()
+{
+	{
+		std::lock_guard<std::mutex> guardTuner(m_mtxTuner);
+		if (!m_pinstTuner) {
+			return;
+		}
+		m_bTunerStop = true;
+	}
+	m_condTuner.notify_all();
+	m_thrTuner.join();
+
+	std::lock_guard<std::mutex> guardTuner(m_mtxTuner);
+	m_pinstTuner.reset();
+	std::lock_guard<std::mutex> guard(m_mtxTask);
+	__setActiveWorkerLimit(m_uThreadCount);
+}
+
+std::vector<AutoTuner::TuneSample> ThreadPool::getAutoTuneHistory()
+{
+	std::lock_guard<std::mutex> guardTuner(m_mtxTuner);
+	return m_pinstTuner ? m_pinstTuner->getHistory() : std::vector<AutoTuner::TuneSample>();
+}
+
+UINT ThreadPool::getActiveWorkerLimit()
+{
+	std::lock_guard<std::mutex> guard(m_mtxTask);
+	return m_uActiveLimit;
+}
+
+VOID ThreadPool::__autoTuneLoop()
+{
+	auto tpEpoch = std::chrono::steady_clock::now();
+	auto tpLast = tpEpoch;
+	unsigned long long ullLastRun = m_ullTasksRun.load();
+	unsigned long long ullLastBusyNs = m_ullBusyNs.load();
+
+	std::unique_lock<std::mutex> uTunerLocker(m_mtxTuner);
+	while (!m_bTunerStop) {
+		m_condTuner.wait_for(uTunerLocker, std::chrono::milliseconds(m_pinstTuner->getConfig().uIntervalMs),
+		                     [this] { return m_bTunerStop; });
+		if (m_bTunerStop) {
+			break;
+		}
+		auto tpNow = std::chrono::steady_clock::now();
+		double dSeconds = std::chrono::duration<double>(tpNow - tpLast).count();
+		unsigned long long ullRun = m_ullTasksRun.load();
+		unsigned long long ullBusyNs = m_ullBusyNs.load();
+
+		std::lock_guard<std::mutex> guard(m_mtxTask);
+		UINT uWorkers = (std::min)(m_uActiveLimit, (UINT)m_pThreadHandleTbl->size());
+		double dUtilization = uWorkers == 0 ? 0.0 : (ullBusyNs - ullLastBusyNs) / (dSeconds * 1e9 * uWorkers);
+		UINT uNext = m_pinstTuner->step((unsigned long long)std::chrono::duration_cast<std::chrono::milliseconds>(tpNow - tpEpoch).count(),
+		                                (ullRun - ullLastRun) / dSeconds, (std::min)(dUtilization, 1.0), m_qTasks.size());
+		__setActiveWorkerLimit(uNext);
+
+		tpLast = tpNow;
+		ullLastRun = ullRun;
+		ullLastBusyNs = ullBusyNs;
+	}
+}
+
+/** 
+Function:	__setActiveWorkerLimit()
+@brief      Let workers 0..uLimit-1 take tasks. Raising it wakes parked workers and starts new ones
+            for a backlog; lowering it parks the others once they finish their current batch.
+@param[in]  uLimit
+@param[out] None
+@return     None    
+*/
+VOID ThreadPool::__setActiveWorkerLimit(UINT uLimit)
+{
+	UINT uOld = m_uActiveLimit;
+	m_uActiveLimit = uLimit;
+	if (uLimit <= uOld) {
+		return;
+	}
+	m_condWorkerParked.notify_all();
+	size_t uAvailable = (size_t)m_iIdleWorkers.load(std::memory_order_relaxed) +
+	                    (std::min)((size_t)uLimit, m_pThreadHandleTbl->size()) - (std::min)((size_t)uOld, m_pThreadHandleTbl->size());
+	while (m_qTasks.size() > uAvailable && m_pThreadHandleTbl->size() < uLimit &&
+	       __runWorker(&ThreadPool::__threadWorker)) {
+		uAvailable++;
+	}
+}
+
+VOID ThreadPool::setEpochDomain(EpochDomain* pinstDomain)
+{
+	m_pinstEpoch.store(pinstDomain);
+}
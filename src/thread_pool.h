@@ -3,17 +3,22 @@
 
 #include <functional>
 #include <atomic>
-#include <queue>
+#include <deque>
 #include <mutex>
 #include <condition_variable>
+#include <memory>
+#include <vector>
 
-/*Linux has <pthread.h> to support multithread while WIN32 has <thread>*/
+/*the pool is written against WIN32 types, on linux they map onto <pthread.h>*/
 #ifdef __linux__
 #include <stdlib.h>
 #include <pthread.h>
-static pthread_mutex_t lock;		//lock--mutex used in linux
-static pthread_cond_t task_ready;	//task_ready--condition variable in linux
-#pragma comment(lib,"x86/pthreadVC2.lib")
+typedef void          VOID;
+typedef unsigned int  UINT;
+typedef unsigned int  DWORD;
+typedef void*         LPVOID;
+typedef pthread_t     HANDLE;
+#define WINAPI
 using namespace std;
 #elif _WIN32
 
@@ -24,12 +29,19 @@ using namespace std;
 #endif  //WIN32_LEAN_AND_MEAN
 
 #include <Windows.h>
-#include <thread>
 #endif  //OS_DEFINE
+#include <thread>
 
-#include "..\include\singleton.h"
+#include "../include/singleton.h"
+#include "../include/epoch.h"
+#include "scratch_arena.h"
+#include "task_tracer.h"
+#include "reactor.h"
+#include "fair_queue.h"
+#include "auto_tuner.h"
 
 #define MAX_THREADS (20)	//The max number of threads that can be created.
+#define MAX_BATCH_TASKS (16)	//The most tasks a worker takes from the queue at once.
 
 #ifdef _MYDEBUG
 #define DP (printf("%s:%u %s:%s:\t", __FILE__, __LINE__, __DATE__, __TIME__), printf) 
@@ -100,6 +112,17 @@ using namespace std;
 
 	3. use "addTask"
 	addTask(fnProc, pvA);
+
+	4. workers start with the first tasks; to have them ready beforehand
+	ThreadPool::getInstance()->prewarm(MAX_THREADS);
+
+	5. small stacks, names for top/perf and real-time priority, before the first task
+	ThreadPool::ThreadAttr stAttr;
+	stAttr.uStackSize = 256 * 1024;
+	stAttr.pcName = "rt-io";
+	stAttr.eSched = ThreadPool::THREAD_SCHED_FIFO;
+	stAttr.iRtPriority = 10;
+	ThreadPool::getInstance()->setThreadAttr(stAttr);
 */
 class ThreadPool : public Singleton<ThreadPool>
 {
@@ -113,9 +136,15 @@ public:
 	{
 		CallBack_T pfnProc;
 		VOID* pvArg;
-		tagTask(CallBack_T pfnInput=nullptr, VOID* pvArgInput=nullptr):
+		const char* pcLabel;				//shown in traces
+		unsigned long long ullTraceId;		//0 when tracing is off
+		FairTaskQueue::PTenant pstTenant;	//queue it was added to
+		tagTask(CallBack_T pfnInput=nullptr, VOID* pvArgInput=nullptr, const char* pcLabelInput=nullptr):
 			pfnProc(pfnInput),
-			pvArg(pvArgInput)
+			pvArg(pvArgInput),
+			pcLabel(pcLabelInput),
+			ullTraceId(0),
+			pstTenant(nullptr)
 		{
 		}
 	}Task, *PTask;
@@ -138,39 +167,164 @@ public:
 			pfnThreadProc = nullptr;
 		}
 	}Proc, *PProc;
+	typedef struct tagWorkerBatch
+	{
+		PTask apTasks[MAX_BATCH_TASKS];
+		UINT  uHead;	//next to run
+		UINT  uCount;
+		tagWorkerBatch():
+			uHead(0),
+			uCount(0)
+		{
+		}
+	}WorkerBatch, *PWorkerBatch;
+	typedef enum tagThreadSched
+	{
+		THREAD_SCHED_NORMAL,	//time sharing, iNice applies
+		THREAD_SCHED_FIFO,		//linux SCHED_FIFO; WIN32 THREAD_PRIORITY_TIME_CRITICAL
+		THREAD_SCHED_RR			//linux SCHED_RR; WIN32 THREAD_PRIORITY_TIME_CRITICAL
+	}ThreadSched_E;
+	typedef enum tagThreadAttrFailure
+	{
+		THREAD_ATTR_STACK_FAILED = 1,	//bits of getThreadAttrFailures(), the OS default was kept
+		THREAD_ATTR_NAME_FAILED  = 2,
+		THREAD_ATTR_NICE_FAILED  = 4,
+		THREAD_ATTR_SCHED_FAILED = 8
+	}ThreadAttrFailure_E;
+	typedef struct tagThreadAttr
+	{
+		size_t        uStackSize;	//0 keeps the OS default, else rounded up to the platform minimum
+		const char*   pcName;		//static string, workers are named "<pcName>-<n>"; nullptr keeps the default
+		int           iNice;		//-20..19; on WIN32 mapped onto THREAD_PRIORITY_*
+		ThreadSched_E eSched;
+		int           iRtPriority;	//1..99 with THREAD_SCHED_FIFO/RR on linux
+		tagThreadAttr():
+			uStackSize(0),
+			pcName(nullptr),
+			iNice(0),
+			eSched(THREAD_SCHED_NORMAL),
+			iRtPriority(1)
+		{
+		}
+	}ThreadAttr, *PThreadAttr;
+	typedef struct tagDequeueStats
+	{
+		unsigned long long ullLockAcquisitions;	//times a worker took m_mtxTask to dequeue
+		unsigned long long ullTasks;			//tasks run
+	}DequeueStats, *PDequeueStats;
 
 	ThreadPool();
 	explicit ThreadPool(UINT);
 	~ThreadPool();
 
-	VOID addTask(CallBack_T pfnProcess, VOID* pvArgInput);//addTask--add task to the queue and notify a thread to work
+	VOID addTask(CallBack_T pfnProcess, VOID* pvArgInput, const char* pcLabel = nullptr);//addTask--add task to the queue and notify a thread to work
+
+	/*every tenant has its own queue, workers serve them by weighted deficit round robin*/
+	VOID addTask(UINT uTenant, CallBack_T pfnProcess, VOID* pvArgInput, const char* pcLabel = nullptr);
+	VOID setTenant(UINT uTenant, UINT uWeight, UINT uMaxRunning = 0);	//setTenant--weight and concurrency cap, 0 for none
+	FairTaskQueue::TenantStats getTenantStats(UINT uTenant);			//getTenantStats--wait times and counts
+
+	/*workers start on demand, when the queue is deeper than the idle workers, up to the pool size*/
+	UINT prewarm(UINT uCount);		//prewarm--start uCount workers now and wait until they are ready
+	UINT getWorkerCount();			//getWorkerCount--workers started so far
+	bool runPendingTask();			//runPendingTask--run one queued task on the calling thread instead of blocking
+
+	/*stack size, name and scheduling of the workers started from now on, set it before the first task*/
+	VOID setThreadAttr(const ThreadAttr& stAttr);
+	UINT getThreadAttrFailures();	//getThreadAttrFailures--THREAD_ATTR_*_FAILED bits, unprivileged requests fall back to the default
+
+	/*a controller thread hill-climbs the number of workers allowed to take tasks, see AutoTuner*/
+	bool enableAutoTune(const AutoTuner::TuneConfig& stConfig);	//enableAutoTune--false if it is already on
+	VOID disableAutoTune();										//disableAutoTune--every worker may take tasks again
+	std::vector<AutoTuner::TuneSample> getAutoTuneHistory();	//getAutoTuneHistory--latest AUTO_TUNE_HISTORY readings and decisions
+	UINT getActiveWorkerLimit();
+
+	/*workers that run out of tasks free the domain's retired nodes, see EpochDomain*/
+	VOID setEpochDomain(EpochDomain* pinstDomain);	//setEpochDomain--nullptr detaches, the domain must outlive the pool
+
+	/*task timeline tracing, see TaskTracer; when off each task pays one branch per event point*/
+	VOID enableTracing(size_t uEventsPerThread = TRACE_RING_SIZE);	//enableTracing--start recording enqueue/begin/end events
+	VOID disableTracing();											//disableTracing--stop recording, recorded events are kept
+	bool dumpTrace(const char* pcFileName);							//dumpTrace--write Chrome trace-event JSON, false if never enabled
+
+	/*workers dequeue up to MAX_BATCH_TASKS tasks per lock, fewer when the queue is short or peers are idle*/
+	VOID setMaxBatch(UINT uMaxBatch);		//setMaxBatch--1 turns batching off
+	DequeueStats getDequeueStats();
+	static VOID releaseBatch();			//releaseBatch--call from a task about to block, its worker's unstarted tasks go back to the queue
+
+	/*per-worker scratch memory, everything allocated from it is dropped when the task returns*/
+	static ScratchArena* getScratchArena();							//getScratchArena--arena of the calling worker, nullptr outside a pool
+	static std::pmr::memory_resource* getScratchResource();		//getScratchResource--the arena in a worker, new/delete elsewhere
+	ScratchArena::ScratchStats getScratchStats();					//getScratchStats--summed over workers, uHighWater is the max
 
 #ifdef __linux__
-	static void cleanup(pthread_mutex_t* lock);			//cleanup--release the mutex when the thread is stopped
-#elif _WIN32
+	/*fd readiness and timers on an epoll reactor, the callback is queued as a normal task once ready*/
+	bool startReactor(Reactor::DriveMode_E eMode = Reactor::REACTOR_THREAD);	//startReactor--once, before the wait calls below
+	bool addTaskOnReadable(int iFd, CallBack_T pfnProcess, VOID* pvArgInput);	//addTaskOnReadable--one-shot, false if fd already has a read waiter
+	bool addTaskOnWritable(int iFd, CallBack_T pfnProcess, VOID* pvArgInput);
+	int  addTaskAfter(UINT uMs, CallBack_T pfnProcess, VOID* pvArgInput);		//addTaskAfter--returns the timer id, -1 on failure
+	UINT cancelWait(int iFd);								//cancelWait--drop pending waits of a fd or timer id
 #endif
 
 	friend class Singleton<ThreadPool>;	// friend class for adapt Abstract Singletion
 private:
-#ifdef __linux__
-	static void* tp_thread_worker();					//tp_thread_worker--thread worker function in linux
-
-	pthread_t* threads;			//pointer of threads
-#elif _WIN32
-	DWORD WINAPI __threadWorker(LPVOID pvParam);//__threadWorker--thread worker function in windows
+	DWORD WINAPI __threadWorker(LPVOID pvParam);//__threadWorker--thread worker function
 	DWORD WINAPI __runWorker(MEMBER_PROC_FUNC pfnMemberProc);
+#ifdef __linux__
+	static void* __linuxThreadEntry(void* pvThis);	//__linuxThreadEntry--pthread start routine, calls __threadWorker
+#endif
 
 	vector<HANDLE>     *m_pThreadHandleTbl;
 	DWORD               m_dwThreadId;	//m_dwThreadId--thread have an id
 	Proc                m_unProc;
+	ScratchArena* __attachScratchArena();	//__attachScratchArena--create the arena of the calling worker
+	VOID __applyThreadAttr(UINT uIndex);	//__applyThreadAttr--name and scheduling, run by the worker itself
+	VOID __autoTuneLoop();
+	VOID __setActiveWorkerLimit(UINT uLimit);	//__setActiveWorkerLimit--called with m_mtxTask held
+	VOID __runTask(PTask pTmpTask, ScratchArena* pinstArena);
+	UINT __batchSize();
+	bool __reactorUndriven();
+#ifdef __linux__
+	bool __driveReactor(std::unique_lock<std::mutex>& uLocker);	//__driveReactor--poll for IO instead of sleeping
 #endif
 
-    UINT                m_uThreadCount;	//m_thread_count in need
+    UINT                m_uThreadCount;	//m_thread_count in need, the most workers started
 	mutex               m_mtxTask;	//sg_mtxTask--mutex used in WIN32
 	condition_variable  m_condTaskReady; //sg_condTaskReady--condition variable in WIN32
 	std::atomic<int>    m_iTaskNum;//sg_iTaskNum--the number of qTasks that haven't been dealt with
 	std::atomic<bool>   m_bStoped;
-	std::queue<PTask>   m_qTasks;//qTasks--the queue that qTasks are waiting for worker thread
+	FairTaskQueue       m_qTasks;//qTasks--the queues that qTasks are waiting for worker thread, one per tenant
+	std::atomic<int>    m_iIdleWorkers;	//workers waiting on m_condTaskReady
+	std::atomic<UINT>   m_uMaxBatch;
+	unsigned long long  m_ullDequeueLocks;	//guarded by m_mtxTask
+	std::atomic<unsigned long long> m_ullTasksRun;
+	UINT                m_uStartedWorkers;	//workers past their setup, guarded by m_mtxTask
+	condition_variable  m_condWorkerStarted;
+	ThreadAttr          m_stThreadAttr;		//guarded by m_mtxTask
+	std::atomic<UINT>   m_uAttrFailures;
+	UINT                m_uActiveLimit;		//workers numbered from it on are parked, guarded by m_mtxTask
+	condition_variable  m_condWorkerParked;
+	std::atomic<unsigned long long> m_ullBusyNs;	//time spent in tasks, for the tuner's utilization
+	std::atomic<EpochDomain*> m_pinstEpoch;
+
+	std::mutex                  m_mtxTuner;
+	condition_variable          m_condTuner;
+	bool                        m_bTunerStop;		//guarded by m_mtxTuner
+	std::unique_ptr<AutoTuner>  m_pinstTuner;		//guarded by m_mtxTuner
+	std::thread                 m_thrTuner;
+
+	std::mutex                                 m_mtxScratch;
+	std::vector<std::unique_ptr<ScratchArena>> m_vecScratchArenas;	//one per worker, owned by the pool
+
+	std::mutex                  m_mtxTracer;
+	std::atomic<TaskTracer*>    m_pinstTracer;		//nullptr while tracing is off
+	std::unique_ptr<TaskTracer> m_pinstTracerStore;	//outlives disableTracing(), in-flight events may still use it
+
+#ifdef __linux__
+	std::unique_ptr<Reactor>    m_pinstReactor;		//set once by startReactor()
+	std::atomic<Reactor*>       m_pinstReactorLive;	//read without locks by the wait calls
+	bool                        m_bReactorDriven;	//a worker is inside poll(), guarded by m_mtxTask
+#endif
 };
 
 #endif //THREAD_POOL_H_
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "unit_test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "../src/thread_pool.h"
+
+// throughput that rises with workers up to iPeak and falls after it, like lock contention would
+static double peakedThroughput(unsigned int uWorkers, unsigned int uPeak)
+{
+    if (uWorkers <= uPeak) {
+        return 100.0 * uWorkers;
+    }
+    return 100.0 * uPeak - 30.0 * (uWorkers - uPeak);
+}
+
+TEST(autoTunerFindsPeak)
+{
+    AutoTuner::TuneConfig stConfig;
+    stConfig.uMinWorkers = 1;
+    stConfig.uMaxWorkers = 16;
+    stConfig.uNoisePercent = 2;
+    AutoTuner instTuner(stConfig, 1);
+
+    int iAtPeak = 0;
+    for (int i = 0; i < 60; ++i) {
+        unsigned int uWorkers = instTuner.getWorkers();
+        instTuner.step(i, peakedThroughput(uWorkers, 6), 1.0, 100);
+        iAtPeak += (i >= 20 && uWorkers == 6);
+    }
+    EXPECT_GE(iAtPeak, 25);
+    EXPECT_GE(instTuner.getWorkers(), 5u);
+    EXPECT_LE(instTuner.getWorkers(), 7u);
+
+    std::vector<AutoTuner::TuneSample> vecHistory = instTuner.getHistory();
+    EXPECT_EQ(vecHistory.size(), (size_t)60);
+    bool bReversed = false;
+    for (auto& stSample : vecHistory) {
+        bReversed = bReversed || stSample.eDecision == AutoTuner::TUNE_REVERSE;
+        EXPECT_LE(stSample.uNext, 16u);
+    }
+    EXPECT_TRUE(bReversed);
+}
+
+TEST(autoTunerFlatKeepsFew)
+{
+    // CPU-bound on a saturated machine: more workers change nothing
+    AutoTuner::TuneConfig stConfig;
+    stConfig.uMinWorkers = 2;
+    stConfig.uMaxWorkers = 16;
+    AutoTuner instTuner(stConfig, 8);
+    for (int i = 0; i < 60; ++i) {
+        instTuner.step(i, 1000.0, 1.0, 100);
+    }
+    EXPECT_LE(instTuner.getWorkers(), 3u);
+
+    // no backlog: steps down to the minimum
+    for (int i = 0; i < 20; ++i) {
+        instTuner.step(60 + i, 10.0, 0.1, 0);
+    }
+    EXPECT_EQ(instTuner.getWorkers(), 2u);
+}
+
+static int blockingTask(void*)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return 0;
+}
+
+TEST(autoTunePool)
+{
+    // blocking tasks: throughput grows with every worker, the tuner has to climb to the top
+    ThreadPool instPool(8);
+    AutoTuner::TuneConfig stConfig;
+    stConfig.uMinWorkers = 1;
+    stConfig.uIntervalMs = 20;
+    stConfig.uNoisePercent = 10;
+    stConfig.uHoldIntervals = 1;
+    EXPECT_TRUE(instPool.enableAutoTune(stConfig));
+    EXPECT_FALSE(instPool.enableAutoTune(stConfig));
+    EXPECT_EQ(instPool.getActiveWorkerLimit(), 1u);
+
+    for (int i = 0; i < 2000; ++i) {
+        instPool.addTask(blockingTask, nullptr);
+    }
+    EXPECT_EQ(instPool.getWorkerCount(), 1u);
+    for (int i = 0; i < 10000 && instPool.getDequeueStats().ullTasks < 2000; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(instPool.getDequeueStats().ullTasks, 2000ull);
+
+    UINT uMost = 0;
+    for (auto& stSample : instPool.getAutoTuneHistory()) {
+        uMost = (std::max)(uMost, stSample.uNext);
+    }
+    EXPECT_GE(uMost, 6u);
+    EXPECT_LE(uMost, 8u);
+
+    instPool.disableAutoTune();
+    EXPECT_EQ(instPool.getActiveWorkerLimit(), 8u);
+    EXPECT_EQ(instPool.getAutoTuneHistory().size(), (size_t)0);
+}
@@ -0,0 +1,272 @@
+#include "unit_test.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../src/channel.h"
+
+TEST(spscChannelOrder)
+{
+    SpscChannel<int> instChan(100);
+    EXPECT_EQ(instChan.capacity(), (size_t)128);
+    const int iTotal = 200000;
+    std::thread thrProducer([&] {
+        int aiBatch[16];
+        int iNext = 0;
+        while (iNext < iTotal) {
+            UINT uCount = 0;
+            for (; uCount < 16 && iNext + (int)uCount < iTotal; ++uCount) {
+                aiBatch[uCount] = iNext + (int)uCount;
+            }
+            UINT uSent = instChan.trySendBatch(aiBatch, uCount);
+            if (uSent == 0) {
+                std::this_thread::yield();
+            }
+            iNext += (int)uSent;
+        }
+    });
+
+    int iExpect = 0;
+    bool bOrdered = true;
+    int aiBatch[7];
+    while (iExpect < iTotal) {
+        UINT uGot = instChan.tryRecvBatch(aiBatch, 7);
+        if (uGot == 0) {
+            std::this_thread::yield();
+        }
+        for (UINT i = 0; i < uGot; ++i) {
+            bOrdered = bOrdered && aiBatch[i] == iExpect++;
+        }
+    }
+    thrProducer.join();
+    EXPECT_TRUE(bOrdered);
+    int iLeft;
+    EXPECT_FALSE(instChan.tryRecv(iLeft));
+}
+
+template <typename CHANNEL_T>
+static void multiProducerRun(CHANNEL_T& instChan, int iProducers, int iConsumers, int iPerProducer,
+                             std::vector<std::atomic<int>>& vecSeen)
+{
+    std::atomic<int> iReceived(0);
+    std::vector<std::thread> vecThreads;
+    for (int p = 0; p < iProducers; ++p) {
+        vecThreads.emplace_back([&, p] {
+            for (int i = 0; i < iPerProducer; ) {
+                int aiBatch[4];
+                UINT uCount = 0;
+                for (; uCount < 4 && i + (int)uCount < iPerProducer; ++uCount) {
+                    aiBatch[uCount] = p * iPerProducer + i + (int)uCount;
+                }
+                UINT uSent = instChan.trySendBatch(aiBatch, uCount);
+                if (uSent == 0) {
+                    std::this_thread::yield();
+                }
+                i += (int)uSent;
+            }
+        });
+    }
+    const int iTotal = iProducers * iPerProducer;
+    for (int c = 0; c < iConsumers; ++c) {
+        vecThreads.emplace_back([&] {
+            int aiBatch[8];
+            while (iReceived.load() < iTotal) {
+                UINT uGot = instChan.tryRecvBatch(aiBatch, 8);
+                if (uGot == 0) {
+                    std::this_thread::yield();
+                }
+                for (UINT i = 0; i < uGot; ++i) {
+                    vecSeen[aiBatch[i]]++;
+                }
+                iReceived += (int)uGot;
+            }
+        });
+    }
+    for (auto& thr : vecThreads) {
+        thr.join();
+    }
+}
+
+TEST(mpscChannelAllDelivered)
+{
+    MpscChannel<int> instChan(64);
+    std::vector<std::atomic<int>> vecSeen(4 * 20000);
+    multiProducerRun(instChan, 4, 1, 20000, vecSeen);
+    int iWrong = 0;
+    for (auto& iSeen : vecSeen) {
+        iWrong += iSeen.load() != 1;
+    }
+    EXPECT_EQ(iWrong, 0);
+}
+
+TEST(mpmcChannelAllDeliveredOnce)
+{
+    MpmcChannel<int> instChan(64);
+    std::vector<std::atomic<int>> vecSeen(4 * 20000);
+    multiProducerRun(instChan, 4, 4, 20000, vecSeen);
+    int iWrong = 0;
+    for (auto& iSeen : vecSeen) {
+        iWrong += iSeen.load() != 1;
+    }
+    EXPECT_EQ(iWrong, 0);
+
+    // move-only items
+    MpmcChannel<std::unique_ptr<int>> instOwned(4);
+    std::unique_ptr<int> pOne(new int(7));
+    EXPECT_TRUE(instOwned.trySend(std::move(pOne)));
+    std::unique_ptr<int> pGot;
+    EXPECT_TRUE(instOwned.tryRecv(pGot));
+    EXPECT_EQ(*pGot, 7);
+}
+
+typedef struct tagParkCtx
+{
+    ThreadPool            *pinstPool;
+    SpscChannel<int>      *pinstChan;
+    ThreadPool::CallBack_T fnConsume;
+    std::atomic<int>       iSum;
+    std::atomic<int>       iRuns;
+    std::atomic<int>       iActive;
+    std::atomic<int>       iOverlaps;
+}ParkCtx;
+
+TEST(channelParkOnPool)
+{
+    // one worker: a receiver that blocked would starve the senders queued behind it
+    ThreadPool instPool(1);
+    SpscChannel<int> instChan(4);
+    ParkCtx stCtx;
+    stCtx.pinstPool = &instPool;
+    stCtx.pinstChan = &instChan;
+    stCtx.iSum = 0;
+    stCtx.iRuns = 0;
+    stCtx.iActive = 0;
+    stCtx.iOverlaps = 0;
+    stCtx.fnConsume = [](void* pvCtx)->int {
+        ParkCtx* pstCtx = (ParkCtx*)pvCtx;
+        if (pstCtx->iActive++ != 0) {
+            pstCtx->iOverlaps++;
+        }
+        pstCtx->iRuns++;
+        int iItem;
+        while (pstCtx->pinstChan->recvOrPark(iItem, pstCtx->pinstPool, pstCtx->fnConsume, pvCtx)) {
+            pstCtx->iSum += iItem;
+            if (iItem == 0) {
+                break;		//end marker
+            }
+        }
+        pstCtx->iActive--;
+        return 0;
+    };
+    instPool.addTask(stCtx.fnConsume, &stCtx);
+
+    // the sender parks too when the 4-slot ring is full
+    std::atomic<int> iNext(1);
+    ThreadPool::CallBack_T fnProduce;
+    fnProduce = [&](void*)->int {
+        while (iNext.load() <= 101) {
+            int iItem = iNext.load() == 101 ? 0 : iNext.load();
+            if (!instChan.sendOrPark(std::move(iItem), &instPool, fnProduce, nullptr)) {
+                return 0;
+            }
+            iNext++;
+        }
+        return 0;
+    };
+    instPool.addTask(fnProduce, nullptr);
+
+    for (int i = 0; i < 5000 && iNext.load() <= 101; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(stCtx.iSum.load(), 5050);
+    EXPECT_GT(stCtx.iRuns.load(), 1);
+    EXPECT_EQ(stCtx.iOverlaps.load(), 0);
+}
+
+TEST_SERIAL(channelThroughput)
+{
+    // one producer, one consumer: mutex-guarded deque against the rings
+    const int iTotal = 2000000;
+    auto fnTime = [&](std::function<void()> fnProducer, std::function<void()> fnConsumer) {
+        auto tpStart = std::chrono::steady_clock::now();
+        std::thread thrProducer(fnProducer);
+        fnConsumer();
+        thrProducer.join();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tpStart).count();
+    };
+
+    std::mutex mtxQueue;
+    std::deque<int> qLocked;
+    double dLocked = fnTime([&] {
+        for (int i = 0; i < iTotal; ++i) {
+            std::lock_guard<std::mutex> guard(mtxQueue);
+            qLocked.push_back(i);
+        }
+    }, [&] {
+        for (int iGot = 0; iGot < iTotal; ) {
+            std::unique_lock<std::mutex> uLocker(mtxQueue);
+            if (!qLocked.empty()) {
+                qLocked.pop_front();
+                ++iGot;
+            }
+            else {
+                uLocker.unlock();
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    SpscChannel<int> instSpsc(1024);
+    double dSpsc = fnTime([&] {
+        int aiBatch[32];
+        for (int i = 0; i < iTotal; ) {
+            UINT uCount = (UINT)(std::min)(32, iTotal - i);
+            for (UINT k = 0; k < uCount; ++k) {
+                aiBatch[k] = i + (int)k;
+            }
+            UINT uSent = instSpsc.trySendBatch(aiBatch, uCount);
+            if (uSent == 0) {
+                std::this_thread::yield();
+            }
+            i += (int)uSent;
+        }
+    }, [&] {
+        int aiBatch[32];
+        for (int iGot = 0; iGot < iTotal; ) {
+            UINT uGot = instSpsc.tryRecvBatch(aiBatch, 32);
+            if (uGot == 0) {
+                std::this_thread::yield();
+            }
+            iGot += (int)uGot;
+        }
+    });
+
+    MpmcChannel<int> instMpmc(1024);
+    double dMpmc = fnTime([&] {
+        for (int i = 0; i < iTotal; ) {
+            if (instMpmc.trySend(i)) {
+                ++i;
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    }, [&] {
+        int iItem;
+        for (int iGot = 0; iGot < iTotal; ) {
+            if (instMpmc.tryRecv(iItem)) {
+                ++iGot;
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    printf("  2M items: mutex+deque %.1f ms, spsc batch 32 %.1f ms, mpmc single %.1f ms\n", dLocked, dSpsc, dMpmc);
+    EXPECT_LT(dSpsc, dLocked);
+}
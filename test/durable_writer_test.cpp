@@ -0,0 +1,64 @@
+#include "unit_test.h"
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include "../src/durable_writer.h"
+
+static std::string readWholeFile(const char* pcFileName)
+{
+    std::string strContents;
+    FILE* pFile = fopen(pcFileName, "rb");
+    if (pFile == nullptr) {
+        return strContents;
+    }
+    char acBuf[256];
+    size_t uLen;
+    while ((uLen = fread(acBuf, 1, sizeof(acBuf), pFile)) > 0) {
+        strContents.append(acBuf, uLen);
+    }
+    fclose(pFile);
+    return strContents;
+}
+
+TEST(durableWriterLastWriteWins)
+{
+    DurableFileWriter instWriter;
+    std::vector<DurableFileWriter::Result_T> vecResults;
+    for (int i = 0; i < 200; ++i) {
+        vecResults.push_back(instWriter.update("dw_test_a.bin", "snapshot " + std::to_string(i)));
+    }
+    ASSERT_TRUE(instWriter.flush());
+    for (auto& fut : vecResults) {
+        EXPECT_TRUE(fut.get());
+    }
+
+    EXPECT_STREQ(readWholeFile("dw_test_a.bin").c_str(), "snapshot 199");
+    // coalescing: far fewer groups than updates
+    EXPECT_LT(instWriter.getCommitCount(), instWriter.getUpdateCount());
+    remove("dw_test_a.bin");
+}
+
+TEST(durableWriterGroupCommit)
+{
+    DurableFileWriter instWriter;
+    const char* apcFiles[] = { "dw_test_b0.bin", "dw_test_b1.bin", "dw_test_b2.bin" };
+    for (int i = 0; i < 50; ++i) {
+        for (const char* pcFile : apcFiles) {
+            instWriter.update(pcFile, std::string(pcFile) + std::to_string(i));
+        }
+    }
+    ASSERT_TRUE(instWriter.flush());
+    for (const char* pcFile : apcFiles) {
+        EXPECT_STREQ(readWholeFile(pcFile).c_str(), (std::string(pcFile) + "49").c_str());
+        remove(pcFile);
+    }
+
+    // a path that can't be written fails its own future only
+    auto futBad = instWriter.update("no_such_dir/dw_test.bin", "x");
+    auto futGood = instWriter.update("dw_test_b0.bin", "y");
+    EXPECT_FALSE(futBad.get());
+    EXPECT_TRUE(futGood.get());
+    EXPECT_FALSE(instWriter.flush());
+    remove("dw_test_b0.bin");
+}
@@ -0,0 +1,174 @@
+#include "unit_test.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../include/epoch.h"
+#include "../src/thread_pool.h"
+
+#define NODE_ALIVE (0x600DF00Du)
+#define NODE_DEAD  (0xDEADBEEFu)
+
+typedef struct tagStackNode
+{
+    unsigned int         uMagic;
+    int                  iValue;
+    struct tagStackNode* pstNext;
+    std::atomic<int>*    piLive;     // per test, the tests run in parallel
+}StackNode;
+
+static std::mutex s_mtxGraveyard;
+static std::vector<StackNode*> s_vecGraveyard;
+
+// poison instead of free: a reader that still sees the node finds NODE_DEAD
+static void buryNode(void* pvNode)
+{
+    StackNode* pstNode = (StackNode*)pvNode;
+    pstNode->uMagic = NODE_DEAD;
+    (*pstNode->piLive)--;
+    std::lock_guard<std::mutex> guard(s_mtxGraveyard);
+    s_vecGraveyard.push_back(pstNode);
+}
+
+static void emptyGraveyard()
+{
+    std::lock_guard<std::mutex> guard(s_mtxGraveyard);
+    for (StackNode* pstNode : s_vecGraveyard) {
+        delete pstNode;
+    }
+    s_vecGraveyard.clear();
+}
+
+TEST(epochTreiberStress)
+{
+    // lock-free stack: popped nodes are retired while other threads may still be reading them
+    EpochDomain instDomain;
+    std::atomic<int> iLive(0);
+    std::atomic<StackNode*> pstHead(nullptr);
+    std::atomic<int> iBadReads(0);
+    const int iThreads = 4, iOps = 20000;
+
+    std::vector<std::thread> vecThreads;
+    for (int t = 0; t < iThreads; ++t) {
+        vecThreads.emplace_back([&, t] {
+            for (int i = 0; i < iOps; ++i) {
+                StackNode* pstNode = new StackNode{ NODE_ALIVE, t * iOps + i, nullptr, &iLive };
+                iLive++;
+                {
+                    EpochDomain::Guard guard(&instDomain);
+                    pstNode->pstNext = pstHead.load();
+                    while (!pstHead.compare_exchange_weak(pstNode->pstNext, pstNode)) {
+                    }
+                }
+
+                StackNode* pstPopped;
+                {
+                    EpochDomain::Guard guard(&instDomain);
+                    pstPopped = pstHead.load();
+                    while (pstPopped != nullptr) {
+                        // the read a premature free would break
+                        if (pstPopped->uMagic != NODE_ALIVE) {
+                            iBadReads++;
+                        }
+                        if (pstHead.compare_exchange_weak(pstPopped, pstPopped->pstNext)) {
+                            break;
+                        }
+                    }
+                }
+                if (pstPopped != nullptr) {
+                    instDomain.retire(pstPopped, buryNode);
+                }
+                if ((i & 63) == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thr : vecThreads) {
+        thr.join();
+    }
+    EXPECT_EQ(iBadReads.load(), 0);
+    EXPECT_TRUE(pstHead.load() == nullptr);
+
+    // every thread exited and handed its bag over, one synchronize frees all of it
+    instDomain.synchronize();
+    EpochDomain::EpochStats stStats = instDomain.getStats();
+    EXPECT_EQ(stStats.ullRetired, (uint64_t)(iThreads * iOps));
+    EXPECT_EQ(stStats.ullFreed, stStats.ullRetired);
+    EXPECT_EQ(iLive.load(), 0);
+    EXPECT_GT(stStats.ullEpoch, (uint64_t)2);
+    emptyGraveyard();
+}
+
+TEST(epochPinnedReaderBlocksFree)
+{
+    EpochDomain instDomain;
+    std::atomic<int> iLive(0);
+    StackNode* pstNode = new StackNode{ NODE_ALIVE, 1, nullptr, &iLive };
+    iLive++;
+
+    std::atomic<bool> bPinned(false), bRelease(false);
+    std::thread thrReader([&] {
+        EpochDomain::Guard guard(&instDomain);
+        bPinned = true;
+        while (!bRelease.load()) {
+            std::this_thread::yield();
+        }
+    });
+    while (!bPinned.load()) {
+        std::this_thread::yield();
+    }
+
+    instDomain.retire(pstNode, buryNode);
+    for (int i = 0; i < 10; ++i) {
+        instDomain.reclaim();
+    }
+    EXPECT_EQ(pstNode->uMagic, NODE_ALIVE);
+    EXPECT_EQ(instDomain.getStats().ullFreed, (uint64_t)0);
+
+    bRelease = true;
+    thrReader.join();
+    instDomain.synchronize();
+    EXPECT_EQ(instDomain.getStats().ullFreed, (uint64_t)1);
+    EXPECT_EQ(iLive.load(), 0);
+    emptyGraveyard();
+
+    // nodes nobody reclaimed go with the domain
+    {
+        EpochDomain instShort;
+        for (int i = 0; i < 10; ++i) {
+            iLive++;
+            instShort.retire(new StackNode{ NODE_ALIVE, i, nullptr, &iLive }, buryNode);
+        }
+    }
+    EXPECT_EQ(iLive.load(), 0);
+    emptyGraveyard();
+}
+
+TEST(epochIdleWorkersReclaim)
+{
+    EpochDomain instDomain;
+    std::atomic<int> iLive(0);
+    ThreadPool instPool(2);
+    instPool.setEpochDomain(&instDomain);
+    std::atomic<int> iDone(0);
+    for (int i = 0; i < 100; ++i) {
+        instPool.addTask([&](void*)->int {
+            iLive++;
+            instDomain.retire(new StackNode{ NODE_ALIVE, 0, nullptr, &iLive }, buryNode);
+            iDone++;
+            return 0;
+        }, nullptr);
+    }
+    // the workers free everything on their way to sleep, nobody calls reclaim() here
+    for (int i = 0; i < 5000 && (iDone.load() < 100 || iLive.load() != 0); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(iDone.load(), 100);
+    EXPECT_EQ(iLive.load(), 0);
+    EXPECT_EQ(instDomain.getStats().ullFreed, (uint64_t)100);
+    instPool.setEpochDomain(nullptr);
+    emptyGraveyard();
+}
@@ -0,0 +1,111 @@
+#include "unit_test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "../src/thread_pool.h"
+
+TEST(fairQueueWeights)
+{
+    FairTaskQueue instQueue;
+    FairTaskQueue::PTenant pstHeavy = instQueue.tenant(1);
+    FairTaskQueue::PTenant pstLight = instQueue.tenant(2);
+    instQueue.setTenant(1, 3, 0);
+    static int s_iItem;
+    for (int i = 0; i < 100; ++i) {
+        instQueue.pushBack(pstHeavy, &s_iItem, 0);
+        instQueue.pushBack(pstLight, &s_iItem, 0);
+    }
+    EXPECT_EQ(instQueue.size(), (size_t)200);
+
+    int iHeavy = 0;
+    for (int i = 0; i < 40; ++i) {
+        FairTaskQueue::PTenant pstTenant = nullptr;
+        ASSERT_TRUE(instQueue.popNext(&pstTenant, 10) != nullptr);
+        iHeavy += pstTenant == pstHeavy;
+        instQueue.finish(pstTenant);
+    }
+    EXPECT_EQ(iHeavy, 30);
+
+    // a capped tenant is passed over while it has one running
+    instQueue.setTenant(1, 3, 1);
+    FairTaskQueue::PTenant pstFirst = nullptr;
+    FairTaskQueue::PTenant pstNext = nullptr;
+    instQueue.popNext(&pstFirst, 20);
+    for (int i = 0; i < 5; ++i) {
+        instQueue.popNext(&pstNext, 20);
+        if (pstFirst == pstHeavy) {
+            EXPECT_TRUE(pstNext == pstLight);
+        }
+    }
+    FairTaskQueue::TenantStats stStats = instQueue.getStats(1);
+    EXPECT_EQ(stStats.ullSubmitted, 100ull);
+    EXPECT_EQ(stStats.ullWaitNsMax, 20ull);
+    EXPECT_EQ(stStats.uWeight, 3u);
+}
+
+static void busyFor50us()
+{
+    auto tpEnd = std::chrono::steady_clock::now() + std::chrono::microseconds(50);
+    while (std::chrono::steady_clock::now() < tpEnd) {
+    }
+}
+
+static std::atomic<int> s_iFloodDone(0);
+static std::atomic<int> s_iFloodSeenByLast(-1);
+static std::atomic<int> s_iSmallDone(0);
+
+TEST(fairQueueIsolation)
+{
+    // one worker, a tenant with 2000 queued tasks must not delay another tenant's 10
+    ThreadPool instPool(1);
+    for (int i = 0; i < 2000; ++i) {
+        instPool.addTask(1, [](void*)->int { busyFor50us(); s_iFloodDone++; return 0; }, nullptr);
+    }
+    for (int i = 0; i < 10; ++i) {
+        instPool.addTask(2, [](void*)->int {
+            busyFor50us();
+            if (++s_iSmallDone == 10) {
+                s_iFloodSeenByLast = s_iFloodDone.load();
+            }
+            return 0;
+        }, nullptr);
+    }
+    while (s_iSmallDone.load() < 10) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_LT(s_iFloodSeenByLast.load(), 100);
+
+    FairTaskQueue::TenantStats stSmall = instPool.getTenantStats(2);
+    EXPECT_EQ(stSmall.ullCompleted, 10ull);
+    EXPECT_GT(stSmall.ullWaitNsMax, 0ull);
+}
+
+static std::atomic<int> s_iCapActive(0);
+static std::atomic<int> s_iCapPeak(0);
+
+TEST(fairQueueConcurrencyCap)
+{
+    ThreadPool instPool(4);
+    instPool.prewarm(4);
+    instPool.setTenant(7, 1, 1);
+    std::atomic<int> iOthers(0);
+    for (int i = 0; i < 40; ++i) {
+        instPool.addTask(7, [](void*)->int {
+            int iNow = ++s_iCapActive;
+            int iPeak = s_iCapPeak.load();
+            while (iNow > iPeak && !s_iCapPeak.compare_exchange_weak(iPeak, iNow)) {
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            s_iCapActive--;
+            return 0;
+        }, nullptr);
+        instPool.addTask([](void* pv)->int { (*(std::atomic<int>*)pv)++; return 0; }, &iOthers);
+    }
+    for (int i = 0; i < 5000 && instPool.getTenantStats(7).ullCompleted < 40; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(instPool.getTenantStats(7).ullCompleted, 40ull);
+    EXPECT_EQ(s_iCapPeak.load(), 1);
+    EXPECT_EQ(iOthers.load(), 40);
+}
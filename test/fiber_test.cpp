@@ -0,0 +1,133 @@
+#include "unit_test.h"
+
+#ifdef __linux__
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "../src/fiber.h"
+
+TEST(fiberYieldInterleaves)
+{
+    // one worker: two fibers that yield take turns on it
+    ThreadPool instPool(1);
+    FiberScheduler instFibers(&instPool);
+    std::mutex mtxOrder;
+    std::string strOrder;
+    auto fnStep = [&](void* pvName)->int {
+        for (int i = 0; i < 3; ++i) {
+            {
+                std::lock_guard<std::mutex> guard(mtxOrder);
+                strOrder += (const char*)pvName;
+            }
+            EXPECT_TRUE(FiberScheduler::inFiber());
+            FiberScheduler::yield();
+        }
+        return 0;
+    };
+    // hold the worker until both are queued
+    std::atomic<bool> bGate(false);
+    instPool.addTask([&bGate](void*)->int {
+        while (!bGate.load()) {
+            std::this_thread::yield();
+        }
+        return 0;
+    }, nullptr);
+    EXPECT_TRUE(instFibers.spawn(fnStep, (void*)"a"));
+    EXPECT_TRUE(instFibers.spawn(fnStep, (void*)"b"));
+    bGate = true;
+    instFibers.wait();
+    EXPECT_STREQ(strOrder.c_str(), "ababab");
+    EXPECT_FALSE(FiberScheduler::inFiber());
+
+    FiberScheduler::FiberStats stStats = instFibers.getStats();
+    EXPECT_EQ(stStats.ullFinished, 2ull);
+    EXPECT_EQ(stStats.uLive, (size_t)0);
+    EXPECT_EQ(stStats.ullSwitches, 8ull);
+}
+
+TEST(fiberCondVarFreesWorker)
+{
+    // a blocking wait on the only worker: the waiter has to give the worker to the fiber that wakes it
+    ThreadPool instPool(1);
+    FiberScheduler instFibers(&instPool);
+    FiberMutex instMutex;
+    FiberCondVar instReady;
+    bool bReady = false;
+    int iSeen = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        instFibers.spawn([&](void*)->int {
+            std::unique_lock<FiberMutex> uLocker(instMutex);
+            instReady.wait(uLocker, [&bReady] { return bReady; });
+            iSeen++;
+            return 0;
+        }, nullptr);
+    }
+    instFibers.spawn([&](void*)->int {
+        std::lock_guard<FiberMutex> guard(instMutex);
+        bReady = true;
+        instReady.notify_all();
+        return 0;
+    }, nullptr);
+    instFibers.wait();
+    EXPECT_EQ(iSeen, 4);
+}
+
+TEST(fiberMutexExcludes)
+{
+    // the critical section yields halfway, a second fiber getting in would lose an increment
+    ThreadPool instPool(3);
+    FiberScheduler instFibers(&instPool);
+    FiberMutex instMutex;
+    int iCounter = 0;
+    for (int i = 0; i < 200; ++i) {
+        instFibers.spawn([&](void*)->int {
+            for (int j = 0; j < 5; ++j) {
+                std::lock_guard<FiberMutex> guard(instMutex);
+                int iValue = iCounter;
+                FiberScheduler::yield();
+                iCounter = iValue + 1;
+            }
+            return 0;
+        }, nullptr);
+    }
+    // a plain thread takes the same mutex meanwhile
+    for (int j = 0; j < 50; ++j) {
+        std::lock_guard<FiberMutex> guard(instMutex);
+        iCounter++;
+    }
+    instFibers.wait();
+    EXPECT_EQ(iCounter, 1050);
+}
+
+TEST(fiberStacksPooled)
+{
+    ThreadPool instPool(2);
+    FiberScheduler::FiberConfig stConfig;
+    stConfig.uStackSize = 1000;     // rounded up to FIBER_STACK_MIN
+    stConfig.uMaxCachedStacks = 4;
+    FiberScheduler instFibers(&instPool, stConfig);
+
+    std::atomic<int> iDone(0);
+    for (int i = 0; i < 100; ++i) {
+        instFibers.spawn([&iDone](void*)->int {
+            char acBuf[8 * 1024];   // most of the minimum stack
+            memset(acBuf, 0x5A, sizeof(acBuf));
+            FiberScheduler::yield();
+            iDone += acBuf[sizeof(acBuf) - 1] == 0x5A;
+            return 0;
+        }, nullptr);
+        if (i % 10 == 9) {
+            instFibers.wait();      // finished fibers hand their stacks back
+        }
+    }
+    instFibers.wait();
+    EXPECT_EQ(iDone.load(), 100);
+    FiberScheduler::FiberStats stStats = instFibers.getStats();
+    EXPECT_EQ(stStats.ullSpawned, 100ull);
+    EXPECT_LE(stStats.uStacksMapped, (size_t)4);
+    EXPECT_EQ(stStats.uStacksCached, stStats.uStacksMapped);
+}
+#endif
@@ -0,0 +1,130 @@
+#include "unit_test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "../src/pipeline.h"
+
+TEST(pipelineStageModes)
+{
+    ThreadPool instPool(4);
+    Pipeline instPipe(&instPool);
+    int iNext = 0;
+    std::atomic<int> iInSerial(0), iOverlaps(0), iSeenUnordered(0);
+    int iExpect = 0;
+    bool bOrdered = true;
+
+    instPipe.addStage(Pipeline::STAGE_SERIAL_IN_ORDER, [&](VOID*)->VOID* {
+        return iNext < 1000 ? new int(iNext++) : nullptr;
+    }).addStage(Pipeline::STAGE_PARALLEL, [](VOID* pvItem)->VOID* {
+        for (int i = *(int*)pvItem % 7; i > 0; --i) {
+            std::this_thread::yield();
+        }
+        return pvItem;
+    }).addStage(Pipeline::STAGE_SERIAL_OUT_OF_ORDER, [&](VOID* pvItem)->VOID* {
+        if (iInSerial++ != 0) {
+            iOverlaps++;
+        }
+        iSeenUnordered++;
+        iInSerial--;
+        return pvItem;
+    }).addStage(Pipeline::STAGE_SERIAL_IN_ORDER, [&](VOID* pvItem)->VOID* {
+        bOrdered = bOrdered && (*(int*)pvItem == iExpect++);
+        delete (int*)pvItem;
+        return nullptr;
+    });
+    ASSERT_TRUE(instPipe.run(8));
+
+    Pipeline::PipelineStats stStats = instPipe.getStats();
+    EXPECT_EQ(stStats.ullItems, 1000ull);
+    EXPECT_EQ(stStats.ullDropped, 0ull);
+    EXPECT_LE(stStats.uPeakInFlight, 8u);
+    EXPECT_EQ(iSeenUnordered.load(), 1000);
+    EXPECT_EQ(iOverlaps.load(), 0);
+    EXPECT_EQ(iExpect, 1000);
+    EXPECT_TRUE(bOrdered);
+}
+
+TEST(pipelineDropAndRerun)
+{
+    ThreadPool instPool(3);
+    Pipeline instPipe(&instPool);
+    int iNext = 0, iLast = -2;
+    bool bOrdered = true;
+
+    instPipe.addStage(Pipeline::STAGE_SERIAL_IN_ORDER, [&](VOID*)->VOID* {
+        return iNext < 200 ? new int(iNext++) : nullptr;
+    }).addStage(Pipeline::STAGE_PARALLEL, [](VOID* pvItem)->VOID* {
+        if (*(int*)pvItem % 2 != 0) {
+            delete (int*)pvItem;
+            return nullptr;
+        }
+        return pvItem;
+    }).addStage(Pipeline::STAGE_SERIAL_IN_ORDER, [&](VOID* pvItem)->VOID* {
+        // dropped items leave gaps but never reorder the rest
+        bOrdered = bOrdered && (*(int*)pvItem == iLast + 2);
+        iLast = *(int*)pvItem;
+        delete (int*)pvItem;
+        return nullptr;
+    });
+    ASSERT_TRUE(instPipe.run(4));
+    EXPECT_EQ(instPipe.getStats().ullDropped, 100ull);
+    EXPECT_EQ(iLast, 198);
+    EXPECT_TRUE(bOrdered);
+
+    iNext = 0;
+    iLast = -2;
+    ASSERT_TRUE(instPipe.run(1));
+    EXPECT_EQ(instPipe.getStats().uPeakInFlight, 1u);
+    EXPECT_EQ(iLast, 198);
+    EXPECT_TRUE(bOrdered);
+}
+
+TEST(pipelineRunFromWorker)
+{
+    // the only worker runs the pipeline, so run() has to execute the stages itself
+    ThreadPool instPool(1);
+    std::atomic<bool> bDone(false);
+    std::atomic<int> iSum(0);
+    instPool.addTask([&](void*)->int {
+        Pipeline instPipe(&instPool);
+        int iNext = 0;
+        instPipe.addStage(Pipeline::STAGE_SERIAL_IN_ORDER, [&](VOID*)->VOID* {
+            return iNext < 100 ? (VOID*)(intptr_t)(++iNext) : nullptr;
+        }).addStage(Pipeline::STAGE_PARALLEL, [&](VOID* pvItem)->VOID* {
+            iSum += (int)(intptr_t)pvItem;
+            return nullptr;
+        });
+        instPipe.run(4);
+        bDone = true;
+        return 0;
+    }, nullptr);
+    for (int i = 0; i < 5000 && !bDone.load(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_TRUE(bDone.load());
+    EXPECT_EQ(iSum.load(), 5050);
+}
+
+TEST_SERIAL(pipelineSlowestStage)
+{
+    // 2ms serial + 2ms parallel per item: pipelined, the serial stage alone sets the pace
+    ThreadPool instPool(4);
+    Pipeline instPipe(&instPool);
+    int iNext = 0;
+    instPipe.addStage(Pipeline::STAGE_SERIAL_IN_ORDER, [&](VOID*)->VOID* {
+        return iNext < 40 ? (VOID*)(intptr_t)(++iNext) : nullptr;
+    }).addStage(Pipeline::STAGE_PARALLEL, [](VOID* pvItem)->VOID* {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return pvItem;
+    }).addStage(Pipeline::STAGE_SERIAL_IN_ORDER, [](VOID*)->VOID* {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return nullptr;
+    });
+
+    auto tpStart = std::chrono::steady_clock::now();
+    ASSERT_TRUE(instPipe.run(8));
+    double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tpStart).count();
+    printf("  pipeline 40 items, 2ms parallel + 2ms serial: %.1f ms (unpipelined %d ms)\n", dMs, 40 * 4);
+    EXPECT_LT(dMs, 40 * 4 * 0.75);
+}
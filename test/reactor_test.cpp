@@ -0,0 +1,118 @@
+#include "unit_test.h"
+
+#ifdef __linux__
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../src/thread_pool.h"
+
+static bool waitCount(std::atomic<int>& iCount, int iExpect)
+{
+    for (int i = 0; i < 2000 && iCount.load() < iExpect; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return iCount.load() == iExpect;
+}
+
+TEST(reactorPipeReadable)
+{
+    ThreadPool instPool(2);
+    ASSERT_TRUE(instPool.startReactor());
+    int aiPipe[2];
+    ASSERT_EQ(pipe(aiPipe), 0);
+
+    std::atomic<int> iRead(0);
+    char cGot = 0;
+    ASSERT_TRUE(instPool.addTaskOnReadable(aiPipe[0], [&](void*)->int {
+        iRead += (int)read(aiPipe[0], &cGot, 1);
+        return 0;
+    }, nullptr));
+    // a second read waiter on the same fd is refused
+    EXPECT_FALSE(instPool.addTaskOnReadable(aiPipe[0], [](void*)->int { return 0; }, nullptr));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(iRead.load(), 0);
+    ASSERT_EQ(write(aiPipe[1], "x", 1), (ssize_t)1);
+    EXPECT_TRUE(waitCount(iRead, 1));
+    EXPECT_EQ(cGot, 'x');
+
+    // one-shot: more data without a new wait queues nothing
+    ASSERT_EQ(write(aiPipe[1], "y", 1), (ssize_t)1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(iRead.load(), 1);
+    EXPECT_EQ(instPool.cancelWait(aiPipe[0]), 0u);
+    close(aiPipe[0]);
+    close(aiPipe[1]);
+}
+
+TEST(reactorSocketpairBothDirections)
+{
+    ThreadPool instPool(2);
+    ASSERT_TRUE(instPool.startReactor());
+    int aiSock[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, aiSock), 0);
+
+    // read and write waiters on one fd: the writable one fires now, the readable one after the peer writes
+    std::atomic<int> iWritable(0), iReadable(0);
+    ASSERT_TRUE(instPool.addTaskOnReadable(aiSock[0], [&](void*)->int { iReadable++; return 0; }, nullptr));
+    ASSERT_TRUE(instPool.addTaskOnWritable(aiSock[0], [&](void*)->int { iWritable++; return 0; }, nullptr));
+    EXPECT_TRUE(waitCount(iWritable, 1));
+    EXPECT_EQ(iReadable.load(), 0);
+
+    ASSERT_EQ(write(aiSock[1], "ping", 4), (ssize_t)4);
+    EXPECT_TRUE(waitCount(iReadable, 1));
+    EXPECT_EQ(iWritable.load(), 1);
+    close(aiSock[0]);
+    close(aiSock[1]);
+}
+
+TEST(reactorTimerAndCancel)
+{
+    ThreadPool instPool(2);
+    ASSERT_TRUE(instPool.startReactor());
+    std::atomic<int> iFired(0), iCancelled(0);
+
+    auto tpStart = std::chrono::steady_clock::now();
+    int iTimer = instPool.addTaskAfter(30, [&](void*)->int { iFired++; return 0; }, nullptr);
+    int iDropped = instPool.addTaskAfter(10, [&](void*)->int { iCancelled++; return 0; }, nullptr);
+    ASSERT_GE(iTimer, 0);
+    ASSERT_GE(iDropped, 0);
+    EXPECT_EQ(instPool.cancelWait(iDropped), 1u);
+
+    EXPECT_TRUE(waitCount(iFired, 1));
+    long long llElapsedMs = (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - tpStart).count();
+    EXPECT_GE(llElapsedMs, 30ll);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(iCancelled.load(), 0);
+}
+
+TEST(reactorIdleWorker)
+{
+    // one worker both polls and runs tasks: addTask has to pull it out of epoll_wait
+    ThreadPool instPool(1);
+    ASSERT_TRUE(instPool.startReactor(Reactor::REACTOR_IDLE_WORKER));
+    int aiPipe[2];
+    ASSERT_EQ(pipe(aiPipe), 0);
+
+    std::atomic<int> iDone(0);
+    ASSERT_TRUE(instPool.addTaskOnReadable(aiPipe[0], [&](void*)->int {
+        char cByte;
+        iDone += (int)read(aiPipe[0], &cByte, 1);
+        return 0;
+    }, nullptr));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (int i = 0; i < 100; ++i) {
+        instPool.addTask([&iDone](void*)->int { iDone++; return 0; }, nullptr);
+    }
+    EXPECT_TRUE(waitCount(iDone, 100));
+
+    ASSERT_EQ(write(aiPipe[1], "x", 1), (ssize_t)1);
+    EXPECT_TRUE(waitCount(iDone, 101));
+    EXPECT_GE(instPool.addTaskAfter(5, [&iDone](void*)->int { iDone++; return 0; }, nullptr), 0);
+    EXPECT_TRUE(waitCount(iDone, 102));
+    close(aiPipe[0]);
+    close(aiPipe[1]);
+}
+#endif  //__linux__
@@ -0,0 +1,155 @@
+#include "unit_test.h"
+
+#ifdef __linux__
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include "../src/shm_queue.h"
+
+#define SHM_TEST_ADD (1)
+
+typedef struct tagAddRequest
+{
+    uint32_t uLeft;
+    uint32_t uRight;
+    uint64_t ullSum;    // written by the server
+}AddRequest;
+
+static std::string shmTestName(const char* pcTest)
+{
+    char acName[64];
+    snprintf(acName, sizeof(acName), "/ysp-%s-%d", pcTest, (int)getpid());
+    return acName;
+}
+
+static int64_t addHandler(VOID* pvPayload, size_t uLen)
+{
+    if (uLen != sizeof(AddRequest)) {
+        return -1;
+    }
+    AddRequest* pstRequest = (AddRequest*)pvPayload;
+    pstRequest->ullSum = (uint64_t)pstRequest->uLeft + pstRequest->uRight;
+    return (int64_t)pstRequest->ullSum;
+}
+
+// submits uCount additions, keeping the rings full, and checks every result; 0 if all were right
+static int runAddClient(const char* pcName, uint32_t uCount)
+{
+    ShmTaskClient instClient;
+    if (!instClient.attach(pcName)) {
+        return 1;
+    }
+    size_t uArena = 0;
+    AddRequest* pstRequests = (AddRequest*)instClient.getArena(&uArena);
+    if (uArena < uCount * sizeof(AddRequest)) {
+        return 2;
+    }
+    uint32_t uBad = 0;
+    uint32_t uNext = 0;
+    uint32_t uDone = 0;
+    while (uDone < uCount) {
+        while (uNext < uCount) {
+            pstRequests[uNext].uLeft = uNext;
+            pstRequests[uNext].uRight = 3 * uNext;
+            pstRequests[uNext].ullSum = 0;
+            if (!instClient.submit(SHM_TEST_ADD, uNext, uNext * sizeof(AddRequest), sizeof(AddRequest))) {
+                break;      // ring full, collect first
+            }
+            uNext++;
+        }
+        if (instClient.getOutstanding() == 0) {
+            usleep(100);    // the other processes filled the submission ring
+            continue;
+        }
+        ShmWorkItem stResult;
+        if (!instClient.waitResult(&stResult, 5000)) {
+            return 3;
+        }
+        uint64_t ullTag = stResult.ullTag;
+        uBad += stResult.uStatus != SHM_STATUS_DONE || stResult.llResult != (int64_t)(4 * ullTag) ||
+                pstRequests[ullTag].ullSum != 4 * ullTag;
+        uDone++;
+    }
+    return uBad == 0 ? 0 : 4;
+}
+
+TEST(shmQueueRoundTrip)
+{
+    ThreadPool instPool(2);
+    ShmTaskServer::ShmConfig stConfig;
+    stConfig.strName = shmTestName("rt");
+    stConfig.uRingSize = 6;     // rounded up to 8
+    stConfig.uMaxClients = 2;
+    stConfig.uArenaSize = 64 * 1024;
+    ShmTaskServer instServer(&instPool, stConfig);
+    instServer.registerType(SHM_TEST_ADD, addHandler);
+
+    ShmTaskClient instEarly;
+    EXPECT_FALSE(instEarly.attach(stConfig.strName.c_str()));
+    EXPECT_TRUE(instServer.create());
+
+    // two clients, more items than the ring holds
+    EXPECT_EQ(runAddClient(stConfig.strName.c_str(), 300), 0);
+    EXPECT_EQ(runAddClient(stConfig.strName.c_str(), 300), 0);
+
+    ShmTaskClient instFirst, instSecond, instThird;
+    EXPECT_TRUE(instFirst.attach(stConfig.strName.c_str()));
+    EXPECT_TRUE(instSecond.attach(stConfig.strName.c_str()));
+    EXPECT_FALSE(instThird.attach(stConfig.strName.c_str()));    // both slots taken
+
+    // failures come back the same way
+    ShmWorkItem stResult;
+    EXPECT_TRUE(instFirst.submit(99, 7, 0, 16));
+    EXPECT_TRUE(instFirst.submit(SHM_TEST_ADD, 8, 64 * 1024 - 8, 16));
+    EXPECT_TRUE(instFirst.waitResult(&stResult, 5000));
+    EXPECT_EQ(stResult.ullTag, (uint64_t)7);
+    EXPECT_EQ(stResult.uStatus, (uint32_t)SHM_STATUS_UNKNOWN_TYPE);
+    EXPECT_TRUE(instFirst.waitResult(&stResult, 5000));
+    EXPECT_EQ(stResult.ullTag, (uint64_t)8);
+    EXPECT_EQ(stResult.uStatus, (uint32_t)SHM_STATUS_BAD_PAYLOAD);
+    EXPECT_FALSE(instFirst.waitResult(&stResult, 10));     // nothing outstanding
+
+    // uncollected results hold the submissions back
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(instSecond.submit(SHM_TEST_ADD, i, 0, sizeof(AddRequest)));
+    }
+    EXPECT_FALSE(instSecond.submit(SHM_TEST_ADD, 8, 0, sizeof(AddRequest)));
+    instSecond.detach();        // its results are dropped
+    EXPECT_TRUE(instThird.attach(stConfig.strName.c_str()));
+    EXPECT_FALSE(instThird.waitResult(&stResult, 10));
+
+    ShmTaskServer::ShmServerStats stStats = instServer.getStats();
+    EXPECT_GE(stStats.ullCompleted, (unsigned long long)600);
+    EXPECT_EQ(stStats.ullFailed, 2ull);
+}
+
+TEST_SERIAL(shmQueueCrossProcess)
+{
+    ThreadPool instPool(2);
+    ShmTaskServer::ShmConfig stConfig;
+    stConfig.strName = shmTestName("xp");
+    stConfig.uRingSize = 64;
+    stConfig.uMaxClients = 4;
+    ShmTaskServer instServer(&instPool, stConfig);
+    instServer.registerType(SHM_TEST_ADD, addHandler);
+    EXPECT_TRUE(instServer.create());
+
+    pid_t aiChildren[3];
+    for (int i = 0; i < 3; ++i) {
+        aiChildren[i] = fork();
+        if (aiChildren[i] == 0) {
+            _exit(runAddClient(stConfig.strName.c_str(), 2000));
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        int iStatus = -1;
+        EXPECT_EQ(waitpid(aiChildren[i], &iStatus, 0), aiChildren[i]);
+        EXPECT_TRUE(WIFEXITED(iStatus));
+        EXPECT_EQ(WEXITSTATUS(iStatus), 0);
+    }
+    ShmTaskServer::ShmServerStats stStats = instServer.getStats();
+    EXPECT_EQ(stStats.ullCompleted, 6000ull);
+    EXPECT_EQ(stStats.ullDropped, 0ull);
+}
+#endif
@@ -0,0 +1,75 @@
+#include "unit_test.h"
+
+#ifdef __linux__
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "../src/spill_queue.h"
+
+typedef struct tagIngestMsg
+{
+    uint32_t uSeq;
+    uint32_t uCheck;
+    char     acBody[56];
+}IngestMsg;
+
+TEST(spillQueueBoundedAndOrdered)
+{
+    // one worker held up by a gate: the whole burst queues before anything runs
+    ThreadPool instPool(1);
+    std::atomic<bool> bGate(false);
+    instPool.addTask([&bGate](void*)->int {
+        while (!bGate.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return 0;
+    }, nullptr);
+
+    SpillTaskQueue::SpillConfig stConfig;
+    stConfig.uMemoryBudget = 64 * 1024;
+    stConfig.uSegmentSize = 1 << 20;	// several segments for the burst
+    SpillTaskQueue instQueue(&instPool, stConfig);
+    uint32_t uNext = 0;
+    bool bOrdered = true;
+    instQueue.registerType(7, [&](const VOID* pvPayload, size_t uLen)->int {
+        const IngestMsg* pstMsg = (const IngestMsg*)pvPayload;
+        bOrdered = bOrdered && uLen == sizeof(IngestMsg) && pstMsg->uSeq == uNext && pstMsg->uCheck == ~pstMsg->uSeq;
+        uNext++;
+        return 0;
+    });
+
+    const uint32_t uTotal = 100000;
+    for (uint32_t i = 0; i < uTotal; ++i) {
+        IngestMsg stMsg;
+        stMsg.uSeq = i;
+        stMsg.uCheck = ~i;
+        ASSERT_TRUE(instQueue.push(7, &stMsg, sizeof(stMsg)));
+    }
+    EXPECT_FALSE(instQueue.push(8, &uNext, sizeof(uNext)));	// unregistered type
+
+    SpillTaskQueue::SpillStats stStats = instQueue.getStats();
+    EXPECT_LE(stStats.uMemoryPeak, (size_t)(64 * 1024));
+    EXPECT_GT(stStats.ullSpilled, 90000ull);
+    EXPECT_GT(stStats.uSegments, (size_t)5);
+
+    bGate = true;
+    instQueue.flush();
+    stStats = instQueue.getStats();
+    EXPECT_EQ(uNext, uTotal);
+    EXPECT_TRUE(bOrdered);
+    EXPECT_EQ(stStats.ullRun, (unsigned long long)uTotal);
+    EXPECT_LE(stStats.uMemoryPeak, (size_t)(64 * 1024));
+    EXPECT_EQ(stStats.uMemoryBytes, (size_t)0);
+    EXPECT_EQ(stStats.uSpillBytes, (size_t)0);
+    EXPECT_EQ(stStats.uSegments, (size_t)0);
+
+    // drained: the next records stay in memory again
+    IngestMsg stMsg;
+    stMsg.uSeq = uTotal;
+    stMsg.uCheck = ~uTotal;
+    EXPECT_TRUE(instQueue.push(7, &stMsg, sizeof(stMsg)));
+    instQueue.flush();
+    EXPECT_EQ(instQueue.getStats().ullSpilled, stStats.ullSpilled);
+    EXPECT_TRUE(bOrdered);
+}
+#endif
@@ -0,0 +1,105 @@
+#include "unit_test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../src/task_group.h"
+
+typedef struct tagFibJob
+{
+    ThreadPool       *pinstPool;
+    int               iN;
+    long long         llResult;
+    std::atomic<UINT>*puMaxDepth;
+}FibJob;
+
+static long long fibSerial(int iN)
+{
+    return iN < 2 ? iN : fibSerial(iN - 1) + fibSerial(iN - 2);
+}
+
+static int fibTask(void* pvJob)
+{
+    FibJob* pstJob = (FibJob*)pvJob;
+    UINT uDepth = TaskGroup::getHelpDepth();
+    UINT uSeen = pstJob->puMaxDepth->load();
+    while (uDepth > uSeen && !pstJob->puMaxDepth->compare_exchange_weak(uSeen, uDepth)) {
+    }
+
+    if (pstJob->iN < 8) {
+        pstJob->llResult = fibSerial(pstJob->iN);
+        return 0;
+    }
+    FibJob stLeft = { pstJob->pinstPool, pstJob->iN - 1, 0, pstJob->puMaxDepth };
+    FibJob stRight = { pstJob->pinstPool, pstJob->iN - 2, 0, pstJob->puMaxDepth };
+    TaskGroup instGroup(pstJob->pinstPool);
+    instGroup.run(fibTask, &stLeft);
+    instGroup.run(fibTask, &stRight);
+    instGroup.wait();
+    pstJob->llResult = stLeft.llResult + stRight.llResult;
+    return 0;
+}
+
+TEST(taskGroupNestedWaits)
+{
+    // far more nested waits than workers: blocking joins would deadlock here
+    ThreadPool instPool(2);
+    std::atomic<UINT> uMaxDepth(0);
+    FibJob stRoot = { &instPool, 22, 0, &uMaxDepth };
+    std::atomic<bool> bDone(false);
+    instPool.addTask([&](void*)->int { fibTask(&stRoot); bDone = true; return 0; }, nullptr);
+    for (int i = 0; i < 10000 && !bDone.load(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_TRUE(bDone.load());
+    EXPECT_EQ(stRoot.llResult, fibSerial(22));
+    EXPECT_LE(uMaxDepth.load(), (UINT)TASK_GROUP_MAX_HELP_DEPTH);
+}
+
+TEST(taskGroupSingleWorker)
+{
+    // the only worker waits on its children, so it has to run all of them itself
+    ThreadPool instPool(1);
+    std::atomic<int> iChildren(0);
+    std::atomic<bool> bDone(false);
+    instPool.addTask([&](void*)->int {
+        TaskGroup instGroup(&instPool);
+        for (int i = 0; i < 100; ++i) {
+            instGroup.run([&iChildren](void*)->int { iChildren++; return 0; }, nullptr);
+        }
+        instGroup.wait();
+        bDone = (iChildren.load() == 100);
+        return 0;
+    }, nullptr);
+    for (int i = 0; i < 5000 && !bDone.load(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_TRUE(bDone.load());
+}
+
+TEST(taskGroupOutsidePool)
+{
+    ThreadPool instPool(4);
+    std::vector<int> vecData(100000, 1);
+    std::atomic<long long> llSum(0);
+    {
+        TaskGroup instGroup(&instPool);
+        for (size_t uBegin = 0; uBegin < vecData.size(); uBegin += 1000) {
+            instGroup.run([&, uBegin](void*)->int {
+                long long llPart = 0;
+                for (size_t i = uBegin; i < uBegin + 1000; ++i) {
+                    llPart += vecData[i];
+                }
+                llSum += llPart;
+                return 0;
+            }, nullptr);
+        }
+        instGroup.wait();
+        EXPECT_EQ(llSum.load(), 100000ll);
+
+        // a group can be reused after wait, the destructor joins the rest
+        instGroup.run([&llSum](void*)->int { llSum++; return 0; }, nullptr);
+    }
+    EXPECT_EQ(llSum.load(), 100001ll);
+}
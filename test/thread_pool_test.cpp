@@ -2,7 +2,18 @@
 
 #include <functional>
 #include <chrono>
-#include "..\src\thread_pool.h"
+#include <string>
+#include <stdio.h>
+#include "../src/thread_pool.h"
+#include "../include/debug.h"
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#endif
+
+LogType LOG_LEVEL = INFO;
 
 int testFunc(void* pvA)
 {
@@ -72,9 +83,243 @@ TEST(memberFunction)
 }
 
 
+TEST(scratchArena)
+{
+    ThreadPool instPool(2);
+    std::atomic<int> iDone(0);
+    std::atomic<int> iBadArena(0);
+    for (int i = 0; i < 64; ++i) {
+        instPool.addTask([&iDone, &iBadArena](void* pvA)->int {
+            ScratchArena* pinstArena = ThreadPool::getScratchArena();
+            if (pinstArena == nullptr || pinstArena->used() != 0) {
+                iBadArena++;    // every task starts on a rewound arena
+            }
+            std::pmr::vector<int> vecTmp(ThreadPool::getScratchResource());
+            for (int j = 0; j < 20000; ++j) {
+                vecTmp.push_back(j);    // outgrows the first chunk
+            }
+            iDone++;
+            return 0;
+        }, nullptr);
+    }
+    while (iDone.load() < 64) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_EQ(iBadArena.load(), 0);
+    ScratchArena::ScratchStats stStats = instPool.getScratchStats();
+    EXPECT_EQ(stStats.ullResets, 64ull);
+    EXPECT_GE(stStats.uHighWater, (size_t)(20000 * sizeof(int)));
+    // after the first overflow a worker's arena is resized once, not every task
+    EXPECT_LT(stStats.ullChunkAllocs, 64ull);
+}
+
+TEST(taskTracing)
+{
+    ThreadPool instPool(3);
+    std::atomic<int> iDone(0);
+    std::function<int(void*)> fnProc = [&iDone](void* pvA)->int { iDone++; return 0; };
+
+    instPool.addTask(fnProc, nullptr, "untraced");
+    instPool.enableTracing(64);
+    for (int i = 0; i < 100; ++i) {
+        instPool.addTask(fnProc, nullptr, "traced");
+    }
+    while (iDone.load() < 101) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    instPool.disableTracing();
+    instPool.addTask(fnProc, nullptr, "untraced");
+
+    ASSERT_TRUE(instPool.dumpTrace("task_trace_test.json"));
+    FILE* pFile = fopen("task_trace_test.json", "rb");
+    ASSERT_TRUE(pFile != nullptr);
+    std::string strJson;
+    char acBuf[4096];
+    size_t uLen;
+    while ((uLen = fread(acBuf, 1, sizeof(acBuf), pFile)) > 0) {
+        strJson.append(acBuf, uLen);
+    }
+    fclose(pFile);
+    remove("task_trace_test.json");
+
+    EXPECT_TRUE(strJson.find("\"traceEvents\"") != std::string::npos);
+    EXPECT_TRUE(strJson.find("\"worker\"") != std::string::npos);
+    EXPECT_TRUE(strJson.find("untraced") == std::string::npos);
+    // the producer ring holds the newest 64 enqueues, workers keep begin and end of theirs
+    size_t uSlices = 0;
+    for (size_t uPos = 0; (uPos = strJson.find("\"ph\":\"B\"", uPos)) != std::string::npos; ++uPos) {
+        ++uSlices;
+    }
+    EXPECT_GT(uSlices, (size_t)0);
+    EXPECT_LE(uSlices, (size_t)100);
+}
+
+static void waitFlag(std::atomic<bool>& bFlag)
+{
+    while (!bFlag.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+TEST(batchedDequeue)
+{
+    ThreadPool instPool(1);
+    std::atomic<bool> bGo(false);
+    std::atomic<int> iDone(0);
+    instPool.addTask([&bGo](void*)->int { waitFlag(bGo); return 0; }, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (int i = 0; i < 1000; ++i) {
+        instPool.addTask([&iDone](void*)->int { iDone++; return 0; }, nullptr);
+    }
+    ThreadPool::DequeueStats stBefore = instPool.getDequeueStats();
+    bGo = true;
+    while (iDone.load() < 1000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    ThreadPool::DequeueStats stAfter = instPool.getDequeueStats();
+    EXPECT_EQ(stAfter.ullTasks - stBefore.ullTasks, 1001ull);
+    EXPECT_LE(stAfter.ullLockAcquisitions - stBefore.ullLockAcquisitions, 1000ull / MAX_BATCH_TASKS + 2);
+}
+
+TEST(releaseBatch)
+{
+    ThreadPool instPool(2);
+    std::atomic<bool> bFirst(false), bSecond(false), bReleased(false);
+    std::atomic<int> iDone(0);
+    instPool.addTask([&bFirst](void*)->int { waitFlag(bFirst); return 0; }, nullptr);
+    instPool.addTask([&bSecond](void*)->int { waitFlag(bSecond); return 0; }, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // the first task of the batch waits on the ones queued behind it
+    instPool.addTask([&](void*)->int {
+        ThreadPool::releaseBatch();
+        bSecond = true;
+        for (int i = 0; i < 1000 && iDone.load() < 10; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        bReleased = (iDone.load() == 10);
+        return 0;
+    }, nullptr);
+    for (int i = 0; i < 10; ++i) {
+        instPool.addTask([&iDone](void*)->int { iDone++; return 0; }, nullptr);
+    }
+    bFirst = true;
+    while (iDone.load() < 10) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(bReleased.load());
+}
+
+TEST(lazyWorkers)
+{
+    ThreadPool instPool(8);
+    EXPECT_EQ(instPool.getWorkerCount(), 0u);
+
+    // tasks run one after another never need a second worker
+    std::atomic<int> iDone(0);
+    for (int i = 0; i < 5; ++i) {
+        instPool.addTask([&iDone](void*)->int { iDone++; return 0; }, nullptr);
+        while (iDone.load() < i + 1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    EXPECT_EQ(instPool.getWorkerCount(), 1u);
+
+    // blocked workers make the queue grow, more start up to the pool size
+    std::atomic<bool> bGo(false);
+    for (int i = 0; i < 20; ++i) {
+        instPool.addTask([&bGo](void*)->int { waitFlag(bGo); return 0; }, nullptr);
+    }
+    EXPECT_EQ(instPool.getWorkerCount(), 8u);
+    bGo = true;
+
+    ThreadPool instWarm(4);
+    EXPECT_EQ(instWarm.prewarm(16), 4u);
+    EXPECT_EQ(instWarm.getWorkerCount(), 4u);
+}
+
+TEST(threadAttributes)
+{
+    ThreadPool instPool(2);
+    ThreadPool::ThreadAttr stAttr;
+    stAttr.uStackSize = 128 * 1024;
+    stAttr.pcName = "tpattr";
+    stAttr.iNice = 5;		// lowering priority needs no privilege
+    instPool.setThreadAttr(stAttr);
+    EXPECT_EQ(instPool.prewarm(2), 2u);
+#ifdef __linux__
+    std::atomic<bool> bDone(false);
+    size_t uStack = 0;
+    int iNice = 0;
+    char acName[16] = { 0 };
+    instPool.addTask([&](void*)->int {
+        pthread_attr_t stSelf;
+        pthread_getattr_np(pthread_self(), &stSelf);
+        pthread_attr_getstacksize(&stSelf, &uStack);
+        pthread_attr_destroy(&stSelf);
+        pthread_getname_np(pthread_self(), acName, sizeof(acName));
+        iNice = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+        bDone = true;
+        return 0;
+    }, nullptr);
+    waitFlag(bDone);
+    EXPECT_GE(uStack, (size_t)(128 * 1024));
+    EXPECT_LT(uStack, (size_t)(1024 * 1024));	// sanitizers may add to it, the 8MB default is gone
+    EXPECT_EQ(strncmp(acName, "tpattr-", 7), 0);
+    EXPECT_EQ(iNice, 5);
+#endif
+    EXPECT_EQ(instPool.getThreadAttrFailures(), 0u);
+
+    // real-time scheduling may be refused, the worker then runs with normal priority
+    ThreadPool instRt(1);
+    ThreadPool::ThreadAttr stRt;
+    stRt.eSched = ThreadPool::THREAD_SCHED_FIFO;
+    stRt.iRtPriority = 5;
+    instRt.setThreadAttr(stRt);
+    std::atomic<bool> bRan(false);
+    instRt.addTask([&bRan](void*)->int { bRan = true; return 0; }, nullptr);
+    waitFlag(bRan);
+    EXPECT_TRUE(bRan.load());
+    EXPECT_EQ(instRt.getThreadAttrFailures() & ~(UINT)ThreadPool::THREAD_ATTR_SCHED_FAILED, 0u);
+}
+
+TEST_SERIAL(startupBenchmark)
+{
+    // construction until the first task returns, then teardown, as a short-lived tool sees it
+    const int iRounds = 50;
+    double adMs[3] = { 0, 0, 0 };
+    for (int iMode = 0; iMode < 3; ++iMode) {
+        auto tpStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < iRounds; ++i) {
+            ThreadPool instPool(MAX_THREADS);
+            if (iMode == 1) {
+                instPool.prewarm(MAX_THREADS);
+            }
+            if (iMode < 2) {
+                std::atomic<bool> bDone(false);
+                instPool.addTask([&bDone](void*)->int { bDone = true; return 0; }, nullptr);
+                while (!bDone.load()) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        adMs[iMode] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tpStart).count() / iRounds;
+    }
+    printf("  startup+1 task: lazy %.3f ms, prewarm(%d) %.3f ms; empty pool %.3f ms\n",
+           adMs[0], MAX_THREADS, adMs[1], adMs[2]);
+    EXPECT_LT(adMs[0], adMs[1]);
+}
+
 int main(int argc, char **argv)
 {
 
 
-    return RUN_ALL_TESTS(argc == 2 ? argv[1] : '\0');
+    return RUN_ALL_TESTS(argc, argv);
 }
\ No newline at end of file
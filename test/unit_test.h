@@ -6,14 +6,22 @@
 #include <cstring>
 #include <cstdio>
 #include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <thread>
+
+#include "../src/thread_pool.h"
 
 #define TEST_NAME(test_name) test_name##_TEST
 
-#define TEST(test_name) \
+#define TEST_IMPL(test_name, serial) \
 class TEST_NAME(test_name) : public TestCase \
 { \
 public: \
-	TEST_NAME(test_name)(const char *name):TestCase(name) { } \
+	TEST_NAME(test_name)(const char *name):TestCase(name, serial) { } \
 	virtual void Run(); \
 private: \
 	static TestCase* const test_case_; \
@@ -22,7 +30,16 @@ TestCase* const TEST_NAME(test_name)::test_case_ = UnitTest::GetInstance()->Regi
 new TEST_NAME(test_name)(#test_name)); \
 void TEST_NAME(test_name)::Run()
 
-#define RUN_ALL_TESTS(str) UnitTest::GetInstance()->Run(str);
+/* TEST runs in parallel with other tests, TEST_SERIAL runs alone (benchmarks, global state) */
+#define TEST(test_name) TEST_IMPL(test_name, false)
+#define TEST_SERIAL(test_name) TEST_IMPL(test_name, true)
+
+/*
+RUN_ALL_TESTS(filter) or RUN_ALL_TESTS(argc, argv), the command line takes
+	[filter] [--jobs n] [--shard i/n] [--results file.json] [--slowest n]
+--shard runs every n-th selected test starting at i, 0 <= i < n
+*/
+#define RUN_ALL_TESTS(...) UnitTest::GetInstance()->Run(__VA_ARGS__);
 
 #define FORMAT_RED(_S)    "\033[0;31m"#_S"\033[0m"
 #define FORMAT_GREEN(_S)    "\033[0;32m"#_S"\033[0m"
@@ -46,19 +63,26 @@ typedef enum OperatorType
 class TestCase
 {
 public:
-	TestCase(const char *CaseName_F) :
+	TestCase(const char *CaseName_F, bool Serial_F = false) :
         m_CaseName_(CaseName_F),
-        m_TestResult_(false)
+        m_TestResult_(false),
+        m_bSerial_(Serial_F),
+        m_dElapsedMs_(0)
     { };
 	virtual ~TestCase() { }
     virtual void Run() = 0;
     const char* getCaseName() const { return m_CaseName_; }
     bool getTestResult() { return m_TestResult_; }
     void setTestResult(bool &&result_F) { m_TestResult_= result_F; }
+    bool isSerial() const { return m_bSerial_; }
+    double getElapsedMs() const { return m_dElapsedMs_; }
+    void setElapsedMs(double dElapsedMs_F) { m_dElapsedMs_ = dElapsedMs_F; }
 
 private:
-    const char* m_CaseName_;
-    bool        m_TestResult_;
+    const char*       m_CaseName_;
+    std::atomic<bool> m_TestResult_;
+    bool              m_bSerial_;
+    double            m_dElapsedMs_;
 };
 
 class UnitTest
@@ -82,46 +106,130 @@ public:
 		return testCase_F;
 	}
 
+	typedef struct tagRunOptions
+	{
+		const char *pcFilter;
+		const char *pcResultsFile;	//json results, nullptr for none
+		UINT        uJobs;			//1 runs everything on the calling thread
+		UINT        uShardIndex;
+		UINT        uShardCount;
+		UINT        uSlowest;		//how many of the slowest tests to list
+		tagRunOptions():
+			pcFilter(nullptr),
+			pcResultsFile(nullptr),
+			uJobs((std::max)(4u, std::thread::hardware_concurrency() * 2)),
+			uShardIndex(0),
+			uShardCount(1),
+			uSlowest(5)
+		{
+		}
+	}RunOptions, *PRunOptions;
+
 	bool Run(const char *str)
+    {
+		RunOptions stOptions;
+		stOptions.pcFilter = str;
+		return Run(stOptions);
+	}
+
+	bool Run(int argc, char **argv)
+    {
+		RunOptions stOptions;
+		for (int i = 1; i < argc; ++i) {
+			if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+				stOptions.uJobs = (std::max)(1, atoi(argv[++i]));
+			} else if (!strcmp(argv[i], "--shard") && i + 1 < argc) {
+				unsigned int uIndex = 0, uCount = 1;
+				if (sscanf(argv[++i], "%u/%u", &uIndex, &uCount) != 2 || uCount == 0 || uIndex >= uCount) {
+					printf("\033[31mbad shard \"%s\", expect i/n with i < n\033[0m\n", argv[i]);
+					return true;
+				}
+				stOptions.uShardIndex = uIndex;
+				stOptions.uShardCount = uCount;
+			} else if (!strcmp(argv[i], "--results") && i + 1 < argc) {
+				stOptions.pcResultsFile = argv[++i];
+			} else if (!strcmp(argv[i], "--slowest") && i + 1 < argc) {
+				stOptions.uSlowest = (UINT)(std::max)(0, atoi(argv[++i]));
+			} else {
+				stOptions.pcFilter = argv[i];
+			}
+		}
+		return Run(stOptions);
+	}
+
+	bool Run(const RunOptions &stOptions)
     {
 		m_bTestResult_ = true;
+		m_iAll_ = m_iPassedNum_ = m_iFailedNum_ = 0;
 
 		printf("\033[33m[ Start ]  Unit Tests\033[0m\n\n");
 
-		m_iAll_ = 0;
+		std::vector<TestCase*> vecParallel, vecSerial, vecSelected;
+		UINT uIndex = 0;
 		for (auto it = m_vecTestCases_.begin(); it != m_vecTestCases_.end(); ++it) {
 			TestCase *test_case = *it;
-            if (str && !strstr(test_case->getCaseName(), str)) {
+            if (stOptions.pcFilter && !strstr(test_case->getCaseName(), stOptions.pcFilter)) {
                 continue;
             }
+			if (uIndex++ % stOptions.uShardCount != stOptions.uShardIndex) {
+				continue;
+			}
+			vecSelected.push_back(test_case);
+			(test_case->isSerial() || stOptions.uJobs <= 1 ? vecSerial : vecParallel).push_back(test_case);
+		}
 
-			++m_iAll_;
-			m_pinstCurrentTestCase_ = test_case;
-			m_pinstCurrentTestCase_->setTestResult(true);
-
-			printf("\033[34m[ Run  ] \033[0m%s\n", test_case->getCaseName());
-
-			test_case->Run();
-
-			if (test_case->getTestResult())
-				printf("\033[32m[ Pass ] \033[0m%s\n", test_case->getCaseName());
-			else
-				printf("\033[31m[ Fail ] \033[0m%s\n", test_case->getCaseName());
-
-			if (test_case->getTestResult()) {
-				++m_iPassedNum_;
-			} else {
-				++m_iFailedNum_;
-				m_bTestResult_ = false;
+		auto tpStart = std::chrono::steady_clock::now();
+		if (!vecParallel.empty()) {
+			ThreadPool instPool((UINT)(std::min<size_t>)(stOptions.uJobs, vecParallel.size()));
+			size_t uLeft = vecParallel.size();
+			std::mutex mtxLeft;
+			std::condition_variable condDone;
+			for (TestCase *test_case : vecParallel) {
+				instPool.addTask([this, test_case, &uLeft, &mtxLeft, &condDone](VOID*)->int {
+					__runTestCase(test_case);
+					std::lock_guard<std::mutex> guard(mtxLeft);
+					if (--uLeft == 0) {
+						condDone.notify_one();
+					}
+					return 0;
+				}, nullptr);
 			}
+			std::unique_lock<std::mutex> uLocker(mtxLeft);
+			condDone.wait(uLocker, [&uLeft] { return uLeft == 0; });
+		}
+		for (TestCase *test_case : vecSerial) {
+			__runTestCase(test_case);
+		}
+		double dWallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tpStart).count();
+
+		std::vector<TestCase*> vecSlowest(vecSelected);
+		std::sort(vecSlowest.begin(), vecSlowest.end(),
+			[](TestCase *a, TestCase *b) { return a->getElapsedMs() > b->getElapsedMs(); });
+		vecSlowest.resize((std::min<size_t>)(vecSlowest.size(), stOptions.uSlowest));
+		if (!vecSlowest.empty()) {
+			printf("\n");
+		}
+		for (TestCase *test_case : vecSlowest) {
+			printf("\033[35m[ SLOW ] \033[0m%s (%.1f ms)\n", test_case->getCaseName(), test_case->getElapsedMs());
 		}
 
-		printf("\n\033[33m[ ALL  ] \033[33;1m%d\033[0m\n", m_iAll_);
+		printf("\n\033[33m[ ALL  ] \033[33;1m%d\033[0m (%.1f ms)\n", m_iAll_, dWallMs);
 		printf("\033[32m[ PASS ] \033[32;1m%d\033[0m\n", m_iPassedNum_);
 		printf("\033[31m[ FAIL ] \033[31;1m%d\033[0m\n", m_iFailedNum_);
+
+		if (stOptions.pcResultsFile && !__writeResults(stOptions.pcResultsFile, vecSelected, dWallMs)) {
+			printf("\033[31mcan't write %s\033[0m\n", stOptions.pcResultsFile);
+			m_bTestResult_ = false;
+		}
 		return !m_bTestResult_;
 	}
-    TestCase& getCrtTestCase(){ return (*m_pinstCurrentTestCase_); }
+
+	/* the test case running on this thread; tasks a test hands to other threads report to the last started one */
+    TestCase& getCrtTestCase()
+    {
+		TestCase *pinstCase = __threadTestCase();
+		return pinstCase ? *pinstCase : *m_pinstCurrentTestCase_.load();
+	}
 
 private:
     UnitTest():
@@ -131,7 +239,60 @@ private:
         m_iPassedNum_(0),
         m_iFailedNum_(0)
     {}
-    TestCase               *m_pinstCurrentTestCase_;
+
+	static TestCase*& __threadTestCase()
+	{
+		thread_local TestCase *tl_pinstTestCase = nullptr;
+		return tl_pinstTestCase;
+	}
+
+	void __runTestCase(TestCase *test_case)
+	{
+		m_pinstCurrentTestCase_ = test_case;
+		__threadTestCase() = test_case;
+		test_case->setTestResult(true);
+
+		printf("\033[34m[ Run  ] \033[0m%s\n", test_case->getCaseName());
+
+		auto tpStart = std::chrono::steady_clock::now();
+		test_case->Run();
+		test_case->setElapsedMs(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tpStart).count());
+		__threadTestCase() = nullptr;
+
+		std::lock_guard<std::mutex> guard(m_mtxResult_);
+		if (test_case->getTestResult())
+			printf("\033[32m[ Pass ] \033[0m%s (%.1f ms)\n", test_case->getCaseName(), test_case->getElapsedMs());
+		else
+			printf("\033[31m[ Fail ] \033[0m%s (%.1f ms)\n", test_case->getCaseName(), test_case->getElapsedMs());
+
+		++m_iAll_;
+		if (test_case->getTestResult()) {
+			++m_iPassedNum_;
+		} else {
+			++m_iFailedNum_;
+			m_bTestResult_ = false;
+		}
+	}
+
+	bool __writeResults(const char *pcFileName, const std::vector<TestCase*> &vecCases, double dWallMs)
+	{
+		FILE *pFile = fopen(pcFileName, "w");
+		if (pFile == nullptr) {
+			return false;
+		}
+		fprintf(pFile, "{\n  \"all\": %d, \"pass\": %d, \"fail\": %d, \"wall_ms\": %.3f,\n  \"tests\": [",
+		        m_iAll_, m_iPassedNum_, m_iFailedNum_, dWallMs);
+		for (size_t i = 0; i < vecCases.size(); ++i) {
+			fprintf(pFile, "%s\n    {\"name\": \"%s\", \"result\": \"%s\", \"serial\": %s, \"ms\": %.3f}",
+			        i ? "," : "", vecCases[i]->getCaseName(), vecCases[i]->getTestResult() ? "pass" : "fail",
+			        vecCases[i]->isSerial() ? "true" : "false", vecCases[i]->getElapsedMs());
+		}
+		fprintf(pFile, "\n  ]\n}\n");
+		return 0 == fclose(pFile);
+	}
+
+    std::atomic<TestCase*>  m_pinstCurrentTestCase_;
+    std::mutex              m_mtxResult_;
     bool                    m_bTestResult_;
     int                     m_iAll_;
     int                     m_iPassedNum_;
@@ -202,7 +363,7 @@ bool CheckNumericalData(ElemType left_value, ElemType right_value,
 	return !condition;
 }
 
-bool CheckStrData(const char *left_value, const char *right_value,
+inline bool CheckStrData(const char *left_value, const char *right_value,
 	              const char *str_left_value, const char *str_right_value,
 	              const char *file_name, const unsigned long line_num,
                   OperatorType operator_type)
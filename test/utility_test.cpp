@@ -0,0 +1,142 @@
+#include "unit_test.h"
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include "../include/utility.h"
+
+/* the old sprintf formatting, one line at a time */
+static std::string referenceHexDump(const unsigned char* pucData, size_t uLen, uintptr_t uAddr)
+{
+    std::string strOut;
+    char acLine[128];
+    for (size_t i = 0; i < uLen; i += 16) {
+        int iPos = snprintf(acLine, sizeof(acLine), "%016llx -", (unsigned long long)(uAddr + i));
+        for (size_t j = 0; j < 16; ++j) {
+            iPos += (i + j < uLen) ? snprintf(acLine + iPos, sizeof(acLine) - iPos, " %02x", pucData[i + j])
+                                   : snprintf(acLine + iPos, sizeof(acLine) - iPos, "   ");
+        }
+        iPos += snprintf(acLine + iPos, sizeof(acLine) - iPos, "  ");
+        for (size_t j = i; j < uLen && j < i + 16; ++j) {
+            acLine[iPos++] = ('!' < pucData[j] && pucData[j] <= '~') ? (char)pucData[j] : '.';
+        }
+        acLine[iPos++] = '\n';
+        strOut.append(acLine, iPos);
+    }
+    return strOut;
+}
+
+TEST(hexDumpFormat)
+{
+    std::vector<unsigned char> vecData(300);
+    for (size_t i = 0; i < vecData.size(); ++i) {
+        vecData[i] = (unsigned char)(i * 7);
+    }
+    const uintptr_t uAddr = (uintptr_t)0xffff80001234fff0ull;
+
+    for (size_t uLen : { (size_t)0, (size_t)1, (size_t)15, (size_t)16, (size_t)17, (size_t)300 }) {
+        std::string strExpect = referenceHexDump(vecData.data(), uLen, uAddr);
+        std::vector<char> vecOut(utility::HexDumpSize(uLen) + 1);
+        size_t uText = utility::HexDump(vecOut.data(), vecOut.size(), vecData.data(), uLen, uAddr);
+        ASSERT_EQ(uText, strExpect.size());
+        ASSERT_EQ(uText, utility::HexDumpSize(uLen));
+        vecOut[uText] = '\0';
+        EXPECT_STREQ(vecOut.data(), strExpect.c_str());
+    }
+
+    // a short buffer takes whole lines only
+    char acSmall[utility::HEXDUMP_LINE_LEN * 2 - 1];
+    EXPECT_EQ(utility::HexDump(acSmall, sizeof(acSmall), vecData.data(), 64, uAddr), utility::HEXDUMP_LINE_LEN);
+}
+
+TEST_SERIAL(hexDumpThroughput)
+{
+    const size_t uLen = 8 << 20;
+    std::vector<unsigned char> vecData(uLen, 0x5a);
+    std::vector<char> vecOut(utility::HexDumpSize(uLen));
+    std::vector<unsigned char> vecCopy(uLen);
+
+    auto tpStart = std::chrono::steady_clock::now();
+    size_t uText = utility::HexDump(vecOut.data(), vecOut.size(), vecData.data(), uLen, 0);
+    auto tpDump = std::chrono::steady_clock::now();
+    memcpy(vecCopy.data(), vecData.data(), uLen);
+    auto tpCopy = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(uText, vecOut.size());
+    double dDumpMs = std::chrono::duration<double, std::milli>(tpDump - tpStart).count();
+    double dCopyMs = std::chrono::duration<double, std::milli>(tpCopy - tpDump).count();
+    printf("  hexdump 8MB: %.2f ms (%.0f MB/s input), memcpy 8MB: %.2f ms\n",
+           dDumpMs, 8 * 1000.0 / dDumpMs, dCopyMs);
+}
+
+TEST(splitView)
+{
+    const char* apcCases[][2] = {
+        { "a,b,,c", "," }, { "", "," }, { "a,", "," }, { ",", "," },
+        { "key::value::", "::" }, { "a:::b", "::" }, { "no delimiter", "--" }, { "x--", "---" },
+    };
+    for (auto& apcCase : apcCases) {
+        std::vector<std::string> vecExpect = StringSplit(apcCase[0], apcCase[1]);
+        std::vector<std::string> vecGot;
+        for (std::string_view svToken : utility::Split(apcCase[0], apcCase[1])) {
+            vecGot.emplace_back(svToken);
+        }
+        ASSERT_EQ(vecGot.size(), vecExpect.size());
+        for (size_t i = 0; i < vecGot.size(); ++i) {
+            EXPECT_STREQ(vecGot[i].c_str(), vecExpect[i].c_str());
+        }
+    }
+    // multi-char delimiters skip the whole delimiter
+    std::vector<std::string> vecFields = StringSplit("1<>2<>3", "<>");
+    ASSERT_EQ(vecFields.size(), (size_t)3);
+    EXPECT_STREQ(vecFields[1].c_str(), "2");
+
+    EXPECT_TRUE(utility::TrimView("  \tpadded \n") == "padded");
+    EXPECT_TRUE(utility::TrimView("   ").empty());
+    std::string strOut;
+    utility::PadLeftInto(strOut, "ab", 4);
+    utility::PadRightInto(strOut, "cd", 3);
+    EXPECT_STREQ(strOut.c_str(), "  abcd ");
+}
+
+TEST_SERIAL(splitViewBenchmark)
+{
+    std::string strLine;
+    for (int i = 0; i < 64; ++i) {
+        strLine += "field" + std::to_string(i) + ", ";
+    }
+    const int iRounds = 20000;
+    size_t uTotal = 0;
+
+    auto tpStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < iRounds; ++i) {
+        for (const std::string& strField : StringSplit(strLine, ", ")) {
+            uTotal += strField.size();
+        }
+    }
+    auto tpCopy = std::chrono::steady_clock::now();
+    for (int i = 0; i < iRounds; ++i) {
+        for (std::string_view svField : utility::Split(strLine, ", ")) {
+            uTotal -= svField.size();
+        }
+    }
+    auto tpView = std::chrono::steady_clock::now();
+
+    std::string strPadded;
+    for (int i = 0; i < iRounds * 16; ++i) {
+        uTotal += PadLeft("value", 12).size();
+    }
+    auto tpPad = std::chrono::steady_clock::now();
+    for (int i = 0; i < iRounds * 16; ++i) {
+        strPadded.clear();
+        utility::PadLeftInto(strPadded, "value", 12);
+        uTotal -= strPadded.size();
+    }
+    auto tpPadInto = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(uTotal, (size_t)0);
+    auto toMs = [](std::chrono::steady_clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    printf("  StringSplit: %.2f ms, Split: %.2f ms; PadLeft: %.2f ms, PadLeftInto: %.2f ms\n",
+           toMs(tpCopy - tpStart), toMs(tpView - tpCopy), toMs(tpPad - tpView), toMs(tpPadInto - tpPad));
+}